@@ -51,9 +51,14 @@ let top = { name = "TOTAL";
                                          * leaf. *)
 let current : t list ref = ref [top]
 
+                                        (* Named counters, the last used 
+                                         * first *)
+let counters : (string * int ref) list ref = ref []
+
 exception NoPerfCount
 let reset (mode: timerModeEnum) : unit = 
   top.sub <- [];
+  counters := [];
   match mode with
     Disabled
   | SoftwareTimer -> timerMode := mode
@@ -71,6 +76,20 @@ let reset (mode: timerModeEnum) : unit =
 
 
 
+let counter (label: string) : int ref =
+  try List.assoc label !counters
+  with Not_found ->
+    let c = ref 0 in
+    counters := (label, c) :: !counters;
+    c
+
+let count (label: string) (n: int) : unit =
+  let c = counter label in
+  c := !c + n
+
+let set_count (label: string) (n: int) : unit =
+  (counter label) := n
+
 let print chn msg = 
   (* Total up *)
   top.time <- List.fold_left (fun sum f -> sum +. f.time) 0.0 top.sub;
@@ -98,6 +117,11 @@ let print chn msg =
   Printf.fprintf chn "Timing used %s\n"
     (if !timerMode = HardwareTimer then "Pentium performance counters"
      else "Unix.time");
+  if !counters <> [] then begin
+    Printf.fprintf chn "Counters:\n";
+    List.iter (fun (label, c) -> Printf.fprintf chn "  %-35s %10d\n" label !c)
+      (List.rev !counters)
+  end;
   let gc = Gc.quick_stat () in 
   let printM (w: float) : string = 
     let coeff = float_of_int (Sys.word_size / 8) in
@@ -116,6 +140,53 @@ let print chn msg =
     gc.Gc.compactions;
     
   ()
+
+let print_json chn = 
+  top.time <- List.fold_left (fun sum f -> sum +. f.time) 0.0 top.sub;
+  let str (s: string) : string = 
+    let b = Buffer.create (String.length s + 2) in
+    Buffer.add_char b '"';
+    String.iter 
+      (fun c -> 
+        match c with
+          '"' | '\\' -> Buffer.add_char b '\\'; Buffer.add_char b c
+        | c when Char.code c < 32 -> 
+            Buffer.add_string b (Printf.sprintf "\\u%04x" (Char.code c))
+        | c -> Buffer.add_char b c) s;
+    Buffer.add_char b '"';
+    Buffer.contents b
+  in
+  let rec prTree node = 
+    Printf.fprintf chn "{\"name\":%s,\"time\":%.6f,\"calls\":%d,\"sub\":["
+      (str node.name) node.time node.ncalls;
+    let first = ref true in
+    List.iter 
+      (fun n -> 
+        if not !first then output_string chn ",";
+        first := false;
+        prTree n)
+      (List.rev node.sub);
+    output_string chn "]}"
+  in
+  output_string chn "{\"timings\":";
+  prTree top;
+  output_string chn ",\"counters\":{";
+  let first = ref true in
+  List.iter 
+    (fun (label, c) -> 
+      if not !first then output_string chn ",";
+      first := false;
+      Printf.fprintf chn "%s:%d" (str label) !c)
+    (List.rev !counters);
+  let gc = Gc.quick_stat () in 
+  let words (w: float) : float = w *. float_of_int (Sys.word_size / 8) in
+  Printf.fprintf chn 
+    "},\"memory\":{\"total_bytes\":%.0f,\"max_bytes\":%.0f,\"minor_collections\":%d,\"major_collections\":%d,\"compactions\":%d}}\n"
+    (words (gc.Gc.minor_words +. gc.Gc.major_words -. gc.Gc.promoted_words))
+    (words (float_of_int gc.Gc.top_heap_words))
+    gc.Gc.minor_collections
+    gc.Gc.major_collections
+    gc.Gc.compactions
         
   
 
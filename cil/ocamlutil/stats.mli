@@ -76,6 +76,22 @@ val repeattime : float -> string -> ('a -> 'b) -> 'a -> 'b
 (** Print the current stats preceeded by a message *)
 val print : out_channel -> string -> unit
 
+(** Add to the counter with the given label. The counters are printed after
+    the timings, in the order they were first used. *)
+val count : string -> int -> unit
+
+(** The counter with the given label, for code that counts often enough that
+    looking the label up every time shows. It is dropped by {!Stats.reset},
+    so take it after. *)
+val counter : string -> int ref
+
+(** Set the counter with the given label (e.g. to the size of a table) *)
+val set_count : string -> int -> unit
+
+(** Print the timings, the counters and the memory statistics as one JSON
+    object *)
+val print_json : out_channel -> unit
+
 (** Return the cumulative time of all calls to {!Stats.time} and
   {!Stats.repeattime} with the given label. *)
 val lookupTime: string -> float
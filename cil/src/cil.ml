@@ -4765,6 +4765,35 @@ let newVID () =
   incr nextGlobalVID;
   t
 
+let renumberIds (f: file) : unit = 
+  (* Collect first: the old ids are unique in f, the new ones may not be *)
+  let vars : (int, varinfo) Hashtbl.t = Hashtbl.create 511 in
+  let comps : (int, compinfo) Hashtbl.t = Hashtbl.create 63 in
+  let seeVar (v: varinfo) = 
+    if not (Hashtbl.mem vars v.vid) then Hashtbl.add vars v.vid v
+  in
+  let seeFun (fd: fundec) = 
+    seeVar fd.svar;
+    List.iter seeVar fd.sformals;
+    List.iter seeVar fd.slocals
+  in
+  List.iter 
+    (fun g -> 
+      match g with
+        GVar (v, _, _) | GVarDecl (v, _) -> seeVar v
+      | GFun (fd, _) -> seeFun fd
+      | GCompTag (ci, _) | GCompTagDecl (ci, _) -> 
+          if not (Hashtbl.mem comps ci.ckey) then Hashtbl.add comps ci.ckey ci
+      | _ -> ())
+    f.globals;
+  (match f.globinit with Some fd -> seeFun fd | None -> ());
+  Hashtbl.iter (fun _ v -> v.vid <- newVID ()) vars;
+  Hashtbl.iter 
+    (fun _ ci -> 
+      ci.ckey <- !nextCompinfoKey;
+      incr nextCompinfoKey)
+    comps
+
    (* Make a varinfo. Used mostly as a helper function below  *)
 let makeVarinfo global name typ =
   (* Strip const from type for locals *)
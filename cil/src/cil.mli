@@ -1548,6 +1548,11 @@ val copyVarinfo: varinfo -> string -> varinfo
  * that is generated by {!Cil.makeLocalVar} and friends *)
 val newVID: unit -> int
 
+(** Give the variables and compinfos of a file built by another process 
+ * (e.g. one read back with Marshal) fresh IDs and keys, so they differ from 
+ * those of every other file of this process *)
+val renumberIds: file -> unit
+
 (** Add an offset at the end of an lvalue. Make sure the type of the lvalue 
  * and the offset are compatible. *)
 val addOffsetLval: offset -> lval -> lval 
@@ -0,0 +1,174 @@
+(* cilcache.ml *)
+(* A disk cache of the files converted to CIL. The entries are keyed by a
+ * digest of the preprocessed source, its name, the CIL version and the
+ * options that change the conversion, and hold the Cil.file right after
+ * cabs2cil, so rmtmps and the features run on it as on a parsed file. *)
+
+open Cil
+module E = Errormsg
+
+(* Changes with the layout of the entries *)
+let cacheVersion = "cil-cache-1"
+
+let cacheDir : string ref = ref ""
+
+let setCacheDir (dir: string) : unit =
+  (try Unix.mkdir dir 0o755 with
+    Unix.Unix_error (Unix.EEXIST, _, _) -> ()
+  | Unix.Unix_error (e, _, _) ->
+      E.s (E.error "Cannot create CIL cache directory %s: %s"
+             dir (Unix.error_message e)));
+  cacheDir := dir
+
+(* Marshal is only read back by the same OCaml and CIL *)
+let entryPath (fname: string) : string =
+  let options =
+    Marshal.to_string
+      (!msvcMode, !lowerConstants, !insertImplicitCasts,
+       !useLogicalOperators, !Cabs2cil.forceRLArgEval,
+       !Cabs2cil.doCollapseCallCast, !envMachine) []
+  in
+  let key =
+    String.concat "\n"
+      [ cacheVersion; Sys.ocaml_version; cilVersion; options; fname;
+        Digest.file fname ]
+  in
+  Filename.concat !cacheDir (Digest.to_hex (Digest.string key) ^ ".cil")
+
+
+(**** Hash-consing of the types ****)
+
+(* cabs2cil builds a new type for every declaration and cast, so the same
+ * few types are written over and over. Before an entry is stored, the types
+ * that print the same are shared; Marshal keeps the sharing. Named types,
+ * structures and enumerations are told apart by name or key, which are
+ * unique in a file. Types with attributes or lengths that are not plain
+ * constants are left alone. *)
+let rec listKey (f: 'a -> string option) (l: 'a list) : string option =
+  match l with
+    [] -> Some ""
+  | x :: rest -> begin
+      match f x, listKey f rest with
+        Some k, Some ks -> Some (k ^ "," ^ ks)
+      | _ -> None
+  end
+
+let rec paramKey (p: attrparam) : string option =
+  match p with
+    AInt n -> Some (string_of_int n)
+  | AStr s -> Some (Printf.sprintf "%S" s)
+  | ACons (s, args) -> begin
+      match listKey paramKey args with
+        Some k -> Some (s ^ "(" ^ k ^ ")")
+      | None -> None
+  end
+  | _ -> None
+
+let attrsKey (a: attributes) : string option =
+  listKey (fun (Attr (s, args)) -> paramKey (ACons (s, args))) a
+
+let rec typKey (t: typ) : string option =
+  let withAttrs (k: string option) (a: attributes) =
+    match k, attrsKey a with
+      Some k, Some ak -> Some (k ^ "[" ^ ak ^ "]")
+    | _ -> None
+  in
+  let wrap (f: string -> string) (k: string option) =
+    match k with Some k -> Some (f k) | None -> None
+  in
+  match t with
+    TVoid a -> withAttrs (Some "void") a
+  | TInt (ik, a) -> withAttrs (Some (Pretty.sprint 80 (d_ikind () ik))) a
+  | TFloat (fk, a) -> withAttrs (Some (Pretty.sprint 80 (d_fkind () fk))) a
+  | TPtr (t', a) -> withAttrs (wrap (fun k -> "*(" ^ k ^ ")") (typKey t')) a
+  | TArray (t', None, a) ->
+      withAttrs (wrap (fun k -> "[](" ^ k ^ ")") (typKey t')) a
+  | TArray (t', Some (Const (CInt64 (n, ik, None))), a) ->
+      let len = Int64.to_string n ^ Pretty.sprint 80 (d_ikind () ik) in
+      withAttrs (wrap (fun k -> "[" ^ len ^ "](" ^ k ^ ")") (typKey t')) a
+  | TArray _ -> None
+  | TFun (rt, args, va, a) -> begin
+      let argKey (n, t', aa) =
+        match typKey t', attrsKey aa with
+          Some k, Some ak -> Some (n ^ ":" ^ k ^ "[" ^ ak ^ "]")
+        | _ -> None
+      in
+      let argsKey =
+        match args with
+          None -> Some "?"
+        | Some l -> listKey argKey l
+      in
+      match typKey rt, argsKey with
+        Some rk, Some ak ->
+          withAttrs (Some (Printf.sprintf "fun(%s;%s;%b)" rk ak va)) a
+      | _ -> None
+  end
+  | TNamed (ti, a) -> withAttrs (Some ("typedef " ^ ti.tname)) a
+  | TComp (ci, a) -> withAttrs (Some ("comp " ^ string_of_int ci.ckey)) a
+  | TEnum (ei, a) -> withAttrs (Some ("enum " ^ ei.ename)) a
+  | TBuiltin_va_list a -> withAttrs (Some "va_list") a
+
+class hashconsVisitor = object
+  inherit nopCilVisitor
+
+  val types : (string, typ) Hashtbl.t = Hashtbl.create 1023
+
+  (* The children first, so their keys are those of the shared types *)
+  method vtype (t: typ) : typ visitAction =
+    ChangeDoChildrenPost
+      (t,
+       (fun t ->
+         match typKey t with
+           None -> t
+         | Some k ->
+             try Hashtbl.find types k
+             with Not_found -> Hashtbl.add types k t; t))
+end
+
+
+(**** The entries ****)
+
+let load (path: string) : Cil.file option =
+  try
+    let ic = open_in_bin path in
+    let res =
+      try
+        let (version: string) = input_value ic in
+        if version = cacheVersion then Some (input_value ic : Cil.file)
+        else None
+      with End_of_file | Failure _ -> None
+    in
+    close_in ic;
+    res
+  with Sys_error _ -> None
+
+(* Write through a temporary file so concurrent runs never read a partial
+ * entry *)
+let store (path: string) (f: Cil.file) : unit =
+  let tmp = Printf.sprintf "%s.%d.tmp" path (Unix.getpid ()) in
+  try
+    let oc = open_out_bin tmp in
+    output_value oc cacheVersion;
+    output_value oc f;
+    close_out oc;
+    Sys.rename tmp path
+  with Sys_error msg ->
+    ignore (E.warn "Cannot store CIL cache entry %s: %s" path msg)
+
+let parse (parseFile: string -> Cil.file) (fname: string) : Cil.file =
+  if !cacheDir = "" then parseFile fname else begin
+    let path = entryPath fname in
+    match Stats.time "cil-cache load" load path with
+      Some f ->
+        if !E.verboseFlag then
+          ignore (E.log "Read %s from the CIL cache\n" fname);
+        renumberIds f;
+        f
+    | None ->
+        let f = parseFile fname in
+        if not !E.hadErrors then begin
+          visitCilFileSameGlobals (new hashconsVisitor) f;
+          Stats.time "cil-cache store" (store path) f
+        end;
+        f
+  end
@@ -0,0 +1,15 @@
+(* cilcache.mli *)
+(* A disk cache of the files converted to CIL (cilly --cil-cache DIR). A
+ * preprocessed source is parsed and converted once; later runs read the
+ * Cil.file back with Marshal. *)
+
+(* The directory of the cache, "" when there is none *)
+val cacheDir: string ref
+
+(* Create the directory if needed and use it as the cache *)
+val setCacheDir: string -> unit
+
+(* The file converted to CIL, from the cache when an entry for the same
+ * source and conversion options exists, otherwise with the given parser, in
+ * which case it is stored. *)
+val parse: (string -> Cil.file) -> string -> Cil.file
@@ -0,0 +1,362 @@
+(* Copyright (C) 2009 Asim Kadav
+ *  Permission is hereby granted,
+ * free of charge, to any person obtaining a copy of this software and
+ * associated documentation files (the "Software"), to deal in the Software
+ * without restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is furnished
+ * to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software. * *THE SOFTWARE
+ * IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED,
+ * INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE
+ *)
+
+(* Device API signature database. Each category (device sources, DMA sinks,
+ * halting calls, report calls, ...) is a hash set of function names, so the
+ * classifiers used by the analyses are constant time. The builtin signatures
+ * below can be extended or trimmed with a signature file (--carb-sigs).
+ *
+ * Signature file format, one entry per line, '#' starts a comment:
+ *
+ *   source   __raw_readl my_vendor_read   (add names to a category)
+ *   source   -ioport_map                  (remove a name from a category)
+ *   dma_arg  dma_map_single 2             (tainted argument positions, from 1)
+ *   gfp_arg  kmalloc 2                    (the position of the gfp flags)
+ *   gfp_atomic_mask  0x20                 (flags that make an allocation atomic)
+ *   gfp_wait_mask  0x10                   (flags that let an allocation sleep)
+ *   report_part  _err                     (names containing _err are reports)
+ *
+ * Categories are free form, so other analyses can keep their functions in the
+ * same file, as security.ml does with livelock and wearout.
+ *)
+
+open Str
+
+module E = Errormsg
+
+(* Category names used by Carburizer. *)
+let cat_source = "source"       (* Reads from the device. Results are tainted. *)
+let cat_sink = "sink"           (* Calls that must not see tainted arguments. *)
+let cat_halting = "halting"     (* Calls that halt the system. *)
+let cat_report = "report"       (* Calls that report an error. *)
+let cat_report_part = "report_part" (* Calls whose names contain one of
+                                     * these report an error too. *)
+let cat_alloc = "alloc"         (* Memory allocation calls. *)
+let cat_free = "free"           (* Calls that free memory. *)
+let cat_dma_arg = "dma_arg"     (* DMA calls, with argument positions. *)
+let cat_gfp_arg = "gfp_arg"     (* Allocators, with the position of their
+                                 * gfp flags. *)
+let cat_mmio_read = "mmio_read" (* Register reads, one bus round trip each. *)
+let cat_mmio_write = "mmio_write" (* Register writes. *)
+let cat_barrier = "barrier"     (* Barriers and waits, after which registers
+                                 * may read differently. *)
+let cat_livelock = "livelock"   (* Delays and waits (security.ml). *)
+let cat_wearout = "wearout"     (* Calls that wear the system out when
+                                 * repeated (security.ml). *)
+
+let categories : (string, (string, unit) Hashtbl.t) Hashtbl.t =
+  Hashtbl.create 17
+
+(* DMA function name -> argument position. Bound once per position. *)
+let dma_args : (string, int) Hashtbl.t = Hashtbl.create 17
+
+(* Allocator name -> position of its gfp flags *)
+let gfp_args : (string, int) Hashtbl.t = Hashtbl.create 17
+
+(* The gfp flags set by GFP_ATOMIC and not by GFP_KERNEL: __GFP_HIGH, 0x20 in
+ * the kernels Carburizer was used on. GFP_NOWAIT does not set it, but lacks
+ * the flag that lets an allocation sleep, __GFP_WAIT (0x10), which
+ * GFP_KERNEL, GFP_NOIO and GFP_NOFS have. The values depend on the kernel
+ * (__GFP_WAIT became __GFP_DIRECT_RECLAIM in 4.4), so a signature file can
+ * set them (gfp_atomic_mask, gfp_wait_mask). *)
+let gfp_atomic_mask : int64 ref = ref (Int64.of_int 0x20)
+let gfp_wait_mask : int64 ref = ref (Int64.of_int 0x10)
+
+let category (cat: string) : (string, unit) Hashtbl.t =
+  try Hashtbl.find categories cat
+  with Not_found ->
+    let set = Hashtbl.create 63 in
+    Hashtbl.add categories cat set;
+    set
+
+(* The report_part entries as one regexp, compiled on first use after they
+ * change. *)
+let report_part_regexp : regexp option ref = ref None
+
+let add (cat: string) (name: string) : unit =
+  if cat = cat_report_part then report_part_regexp := None;
+  Hashtbl.replace (category cat) name ()
+
+let remove (cat: string) (name: string) : unit =
+  if cat = cat_report_part then report_part_regexp := None;
+  Hashtbl.remove (category cat) name;
+  if cat = cat_dma_arg then
+    while Hashtbl.mem dma_args name do Hashtbl.remove dma_args name done;
+  if cat = cat_gfp_arg then Hashtbl.remove gfp_args name
+
+let add_dma_arg (name: string) (pos: int) : unit =
+  add cat_dma_arg name;
+  if not (List.mem pos (Hashtbl.find_all dma_args name)) then
+    Hashtbl.add dma_args name pos
+
+let add_gfp_arg (name: string) (pos: int) : unit =
+  add cat_gfp_arg name;
+  Hashtbl.replace gfp_args name pos
+
+let mem (cat: string) (name: string) : bool =
+  try Hashtbl.mem (Hashtbl.find categories cat) name
+  with Not_found -> false
+
+(* Classifiers *)
+let is_source (name: string) : bool = mem cat_source name
+let is_sink (name: string) : bool = mem cat_sink name
+let is_halting (name: string) : bool = mem cat_halting name
+let is_report (name: string) : bool =
+  mem cat_report name ||
+  (let re =
+     match !report_part_regexp with
+     | Some re -> re
+     | None ->
+         let parts =
+           Hashtbl.fold (fun part () acc -> quote part :: acc)
+             (category cat_report_part) [] in
+         (* An empty alternation would match every name *)
+         let re = regexp (if parts = [] then "$^"
+                          else String.concat "\\|" parts) in
+         report_part_regexp := Some re;
+         re
+   in
+   try ignore (search_forward re name 0); true
+   with Not_found -> false)
+let is_alloc (name: string) : bool = mem cat_alloc name
+let is_free (name: string) : bool = mem cat_free name
+let is_mmio_read (name: string) : bool = mem cat_mmio_read name
+let is_mmio_write (name: string) : bool = mem cat_mmio_write name
+let is_barrier (name: string) : bool = mem cat_barrier name
+let is_livelock (name: string) : bool = mem cat_livelock name
+let is_wearout (name: string) : bool = mem cat_wearout name
+
+(* The argument positions of a DMA call, in increasing order. *)
+let dma_arg_positions (name: string) : int list =
+  List.sort compare (Hashtbl.find_all dma_args name)
+
+(* The position of the gfp flags of an allocator *)
+let gfp_arg_position (name: string) : int option =
+  try Some (Hashtbl.find gfp_args name) with Not_found -> None
+
+(* Builtin signatures. The fi_ functions were used by the fault injection tool
+ * to interpose and introduce errors.
+ *)
+let () =
+  List.iter (add cat_source)
+    [ "ioread8"; "ioread16"; "ioread16be"; "ioread32"; "ioread32be";
+      "ioread8_rep"; "ioread16_rep"; "ioread32_rep";
+      "ioport_map"; "ioport_unmap"; "pci_iomap";
+      "readl"; "readw"; "readb";
+      "inb_p"; "inw_p"; "inl_p"; "inb_local"; "inw_local"; "inl_local";
+      "inb"; "inw"; "inl"; "insw"; "insb"; "insl";
+      "ioremap"; "ioremap_nocache";
+      "dma_alloc_coherent"; "pci_map_consistent"; "mem_request_regions";
+
+      "fi_ioread8"; "fi_ioread16"; "fi_ioread16be"; "fi_ioread32";
+      "fi_ioread32be"; "fi_ioread8_rep"; "fi_ioread16_rep"; "fi_ioread32_rep";
+      "fi_ioport_map"; "fi_ioport_unmap"; "fi_pci_iomap";
+      "fi_readl"; "fi_readw"; "fi_readb";
+      "fi_inb_p"; "fi_inw_p"; "fi_inl_p";
+      "fi_inb_local"; "fi_inw_local"; "fi_inl_local";
+      "fi_inb"; "fi_inw"; "fi_inl"; "fi_insw"; "fi_insb"; "fi_insl";
+      "fi_ioremap"; "fi_ioremap_nocache";
+      "fi_dma_alloc_coherent"; "fi_pci_map_consistent";
+      "fi_mem_request_regions";
+      (* Added b/c it's not inlined like the normal pci_alloc_consistent *)
+      "fi_pci_alloc_consistent";
+    ];
+  List.iter (add cat_halting) [ "panic"; "BUG"; "BUG_ON"; "assert" ];
+  List.iter (add cat_mmio_read)
+    [ "readb"; "readw"; "readl"; "readq";
+      "readb_relaxed"; "readw_relaxed"; "readl_relaxed"; "readq_relaxed";
+      "__raw_readb"; "__raw_readw"; "__raw_readl"; "__raw_readq";
+      "ioread8"; "ioread16"; "ioread16be"; "ioread32"; "ioread32be";
+      "inb"; "inw"; "inl"; "inb_p"; "inw_p"; "inl_p";
+      "fi_readb"; "fi_readw"; "fi_readl";
+      "fi_ioread8"; "fi_ioread16"; "fi_ioread16be"; "fi_ioread32";
+      "fi_ioread32be"; "fi_inb"; "fi_inw"; "fi_inl";
+      "fi_inb_p"; "fi_inw_p"; "fi_inl_p";
+    ];
+  List.iter (add cat_mmio_write)
+    [ "writeb"; "writew"; "writel"; "writeq";
+      "writeb_relaxed"; "writew_relaxed"; "writel_relaxed"; "writeq_relaxed";
+      "__raw_writeb"; "__raw_writew"; "__raw_writel"; "__raw_writeq";
+      "iowrite8"; "iowrite16"; "iowrite16be"; "iowrite32"; "iowrite32be";
+      "outb"; "outw"; "outl"; "outb_p"; "outw_p"; "outl_p";
+      "outsb"; "outsw"; "outsl"; "iowrite8_rep"; "iowrite16_rep";
+      "iowrite32_rep";
+    ];
+  List.iter (add cat_barrier)
+    [ "mb"; "rmb"; "wmb"; "mmiowb"; "barrier";
+      "smp_mb"; "smp_rmb"; "smp_wmb"; "dma_rmb"; "dma_wmb";
+      "udelay"; "ndelay"; "mdelay"; "msleep"; "msleep_interruptible";
+      "usleep_range"; "cpu_relax"; "schedule"; "schedule_timeout";
+    ];
+  List.iter (add cat_sink)
+    [ "dma_map_page"; "dma_map_single"; "pci_map_single";
+      "printk"; "memcpy"; "memzero"; "kmalloc";
+    ];
+  (* Exact names are looked up first. Any other name containing printk,
+   * dev_warn or dev_info (vprintk, dev_warn_ratelimited, ...) is a report
+   * call as well. *)
+  List.iter (add cat_report) [ "printk"; "dev_warn"; "dev_info" ];
+  List.iter (add cat_report_part) [ "printk"; "dev_warn"; "dev_info" ];
+  List.iter (add cat_alloc)
+    [ "kmalloc"; "kmem_alloc"; "kcalloc"; "kzalloc";
+      "kmem_cache_alloc"; "vmalloc";
+      "kmem_cache_zalloc"; "alloc_pages"; "__get_free_pages"; "__get_free_page";
+      "alloc_skb"; "dev_alloc_skb"; "__dev_alloc_skb"; "netdev_alloc_skb";
+      "__netdev_alloc_skb"; "netdev_alloc_skb_ip_align"; "napi_alloc_skb";
+      "skb_copy"; "skb_clone";
+    ];
+  List.iter (add cat_free)
+    [ "kfree"; "kzfree"; "vfree"; "kvfree"; "kmem_cache_free";
+      "free_pages"; "__free_pages"; "free_page";
+      "kfree_skb"; "dev_kfree_skb"; "dev_kfree_skb_any"; "dev_kfree_skb_irq";
+      "consume_skb"; "napi_consume_skb";
+    ];
+  List.iter (add cat_livelock)
+    [ "sleep"; "msleep"; "usleep"; "ssleep"; "rdtscl"; "time_before";
+      "ndelay"; "udelay"; "mdelay"; "schedule_timeout";
+      "wait_event_noninterruptible_timeout";
+      "wait_event_interruptible_timeout"; "wait_event_timeout";
+    ];
+  List.iter (add cat_wearout)
+    [ "kmalloc"; "kzalloc"; "kmem_cache_alloc"; "vfs_write" ];
+  (*To avoid cache coherency problems, right before starting a DMA transfer from
+  * the RAM to the device, the driver should invoke
+  * pci_dma_sync_single_for_device() or dma_sync_single_for_device(), which flush,
+  * if necessary the cache lines corresponding to the DMA buffer. Similarly, a
+  * device driver should not access a memory buffer right after the end of a DMA
+  * transfer from the device to the RAM: instead, before reading the buffer, the
+  * driver should invoke pci_dma_sync_single_for_cpu or dma_sync_single_for_cpu()
+  * ,which  invalidate, if necessary, the corresponding hardware cache lines. This
+  * is not relevant in x86 architecture because the coherency of hardware caches
+  * and DMAs is maintained by the hardware.
+  *)
+  List.iter (fun (name, pos) -> add_dma_arg name pos)
+    [ ("dma_map_single", 2);
+      ("dma_sync_single_for_cpu", 2);
+      ("dma_sync_single_for_device", 2);
+      ("dma_alloc_coherent", 3);
+      ("dma_pool_alloc", 3);
+      ("dma_pool_free", 3);
+      ("dma_free_coherent", 4);
+      ("dma_unmap_single", 2);
+      ("dma_unmap_page", 2);
+      ("pci_dma_sync_single_for_cpu", 2);
+      ("pci_dma_sync_single_for_device", 2);
+      ("pci_unmap_single", 2);
+      ("pci_unmap_page", 2);
+      ("pci_alloc_consistent", 3);
+      ("pci_free_consistent", 4);
+    ];
+  (* For the allocators seen without a prototype, or whose flags are a plain
+   * integer in older kernels. A gfp_t parameter is found by its type. *)
+  List.iter (fun (name, pos) -> add_gfp_arg name pos)
+    [ ("kmalloc", 2); ("kzalloc", 2); ("kcalloc", 3); ("kmalloc_array", 3);
+      ("kmem_cache_alloc", 2); ("kmem_cache_zalloc", 2);
+      ("__get_free_pages", 1); ("__get_free_page", 1); ("alloc_pages", 1);
+      ("alloc_skb", 2); ("__dev_alloc_skb", 2); ("__netdev_alloc_skb", 3);
+      ("skb_copy", 2); ("skb_clone", 2);
+      ("dma_alloc_coherent", 4); ("dma_pool_alloc", 2);
+    ]
+
+let blank_regexp = regexp "[ \t\r]+"
+
+(* Process one line of a signature file. *)
+let load_line (fname: string) (lineno: int) (line: string) : unit =
+  let line =
+    try String.sub line 0 (String.index line '#')
+    with Not_found -> line
+  in
+  let bad_pos (s: string) =
+    E.s (E.error "%s:%d: bad position %s" fname lineno s)
+  in
+  let position (s: string) : int =
+    let pos = try int_of_string s with Failure _ -> bad_pos s in
+    if pos < 1 then bad_pos s;
+    pos
+  in
+  let is_removal (name: string) : bool =
+    String.length name > 1 && name.[0] = '-'
+  in
+  let strip (name: string) : string =
+    String.sub name 1 (String.length name - 1)
+  in
+  match split blank_regexp line with
+  | [] -> ()
+  | [cat] -> E.s (E.error "%s:%d: no functions for %s" fname lineno cat)
+  | cat :: name :: rest when cat = cat_dma_arg ->
+      if is_removal name then remove cat_dma_arg (strip name)
+      else begin
+        if rest = [] then
+          E.s (E.error "%s:%d: no positions for %s" fname lineno name);
+        List.iter (fun s -> add_dma_arg name (position s)) rest
+      end
+  | cat :: name :: rest when cat = cat_gfp_arg ->
+      if is_removal name then remove cat_gfp_arg (strip name)
+      else begin
+        match rest with
+        | [s] -> add_gfp_arg name (position s)
+        | _ -> E.s (E.error "%s:%d: %s takes one position" fname lineno name)
+      end
+  | [("gfp_atomic_mask" | "gfp_wait_mask") as what; mask] ->
+      (if what = "gfp_atomic_mask" then gfp_atomic_mask else gfp_wait_mask) :=
+        (try Int64.of_string mask
+         with Failure _ ->
+           E.s (E.error "%s:%d: bad %s %s" fname lineno what mask))
+  | cat :: names ->
+      List.iter
+        (fun name ->
+          if is_removal name then remove cat (strip name) else add cat name)
+        names
+
+(* Load a signature file on top of the current database. *)
+let load_file (fname: string) : unit =
+  let ic =
+    try open_in fname
+    with Sys_error msg -> E.s (E.error "Cannot open signature file %s" msg)
+  in
+  let lineno = ref 0 in
+  (try
+    while true do
+      let line = input_line ic in
+      incr lineno;
+      load_line fname !lineno line
+    done
+  with End_of_file -> ());
+  close_in ic
+
+(* A digest of the whole database. Results computed under one set of
+ * signatures are only valid for that set. *)
+let digest () : string =
+  let entries = ref [] in
+  Hashtbl.iter
+    (fun cat set ->
+      Hashtbl.iter (fun name () -> entries := (cat ^ " " ^ name) :: !entries)
+        set)
+    categories;
+  Hashtbl.iter
+    (fun name pos ->
+      entries := (Printf.sprintf "%s %s %d" cat_dma_arg name pos) :: !entries)
+    dma_args;
+  Hashtbl.iter
+    (fun name pos ->
+      entries := (Printf.sprintf "%s %s %d" cat_gfp_arg name pos) :: !entries)
+    gfp_args;
+  entries := ("gfp_atomic_mask " ^ Int64.to_string !gfp_atomic_mask) :: !entries;
+  entries := ("gfp_wait_mask " ^ Int64.to_string !gfp_wait_mask) :: !entries;
+  Digest.string (String.concat "\n" (List.sort compare !entries))
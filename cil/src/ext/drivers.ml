@@ -31,93 +31,12 @@ open Ptranal
 (* This is the maximum timeout value. Currently, we generate wait for 200 counts
  * _when_ code generation is enabled.
  *)
-let tickval_exp = (integer 200)
+let tickval: int = 200;;
+let tickval_exp = (integer tickval)
 
-(* This is the list of device functions that Carburizer uses for taint analysis.
- * The fi_ functions were used by fault injection tool to interpose and introduce
- * errors.
+(* The device functions that Carburizer uses for taint analysis, the halting,
+ * DMA and report functions live in the signature database (devsigs.ml).
  *)
-let bad_functions: string list =
-    [ "ioread8";
-      "ioread16";
-      "ioread16be";
-      "ioread32";
-      "ioread32be";
-      "ioread8_rep";
-      "ioread16_rep";
-      "ioread32_rep";
-      "ioport_map";
-      "ioport_unmap";
-      "pci_iomap";
-      "readl";
-      "readw";
-      "inb_p";
-      "inw_p";
-      "inl_p";
-      "inb_local";
-      "inw_local";
-      "inl_local";
-      "ioread8_rep";
-      "ioread16_rep"; 
-      "ioread32_rep";  
-      "inb";
-      "inw";
-      "inl";
-      "readb";
-      "insw";
-      "insb";
-      "insl";
-      "ioremap";
-      "ioremap_nocache";
-      "dma_alloc_coherent";
-      "pci_map_consistent";
-      "mem_request_regions";
-      "ioport_map";
-
-      "fi_ioread8";
-      "fi_ioread16";
-      "fi_ioread16be";
-      "fi_ioread32";
-      "fi_ioread32be";
-      "fi_ioread8_rep";
-      "fi_ioread16_rep";
-      "fi_ioread32_rep";
-      "fi_ioport_map";
-      "fi_ioport_unmap";
-      "fi_pci_iomap";
-      "fi_readl";
-      "fi_readw";
-      "fi_inb_p";
-      "fi_inw_p";
-      "fi_inl_p";
-      "fi_inb_local";
-      "fi_inw_local";
-      "fi_inl_local";
-      "fi_ioread8_rep";
-      "fi_ioread16_rep"; 
-      "fi_ioread32_rep";  
-      "fi_inb";
-      "fi_inw";
-      "fi_inl";
-      "fi_readb";
-      "fi_insw";
-      "fi_insb";
-      "fi_insl";
-
-      "fi_ioremap";
-      "fi_ioremap_nocache";
-      "fi_dma_alloc_coherent";
-      "fi_pci_map_consistent";
-      "fi_mem_request_regions";
-      "fi_ioport_map";
-
-      (************************)
-      (* MJR bonus functions: *)
-      (************************)
-
-      (* Added b/c it's not inlined like the normal pci_alloc_consistent *)
-      "fi_pci_alloc_consistent";
-    ];;
 
 (* Used to check registration of interrupt handlers. *)
 let iNTR_STRING: string = "request_irq";;
@@ -129,9 +48,6 @@ let gen_line_nos: int = 1;;
 
 let add_pk: int ref = ref 1;;
 
-(* Used to check presence of system halting functions. *)
-let halting_fns: string list = [ "panic"; "BUG"; "BUG_ON"; "assert" ] ;;
-
 (* Used to check for contamination. *)
 let bad_memory_ptrs : string list =
     [  "ioremap"; "ioremap_nocache";
@@ -143,10 +59,10 @@ let halt_count: int ref = ref 0;;
 
 let dma_taint: int ref = ref 0;;
 
-let error_line_nos : string list ref = ref [];;
-
 let def_interrupt_fns: string list ref =
     ref [];;
+(* The functions reachable from the interrupt handlers of the file, by vid *)
+let isr_context : (int, unit) Hashtbl.t = Hashtbl.create 17;;
 let intr_correct : int ref = ref 0;;
 let intr_found : int ref = ref 0;;
 
@@ -164,60 +80,11 @@ let more_bad_functions: string list =
     ];;
 
  (* The names of functions with contaminated return values *)
-  let funcs_with_cont_return = ref [];;
-   
-
-(*To avoid cache coherency problems, right before starting a DMA transfer from
-* the RAM to the device, the driver should invoke
-* pci_dma_sync_single_for_device() or dma_sync_single_for_device(), which flush,
-* if necessary the cache lines corresponding to the DMA buffer. Similarly, a
-* device driver should not access a memory buffer right after the end of a DMA
-* transfer from the device to the RAM: instead, before reading the buffer, the
-* driver should invoke pci_dma_sync_single_for_cpu or dma_sync_single_for_cpu()
-* ,which  invalidate, if necessary, the corresponding hardware cache lines. This
-* is not relevant in x86 architecture because the coherency of hardware caches
-* and DMAs is maintained by the hardware.
-*) 
-let dma_bad_functions: string list =
-    [   "dma_map_page";
-	"dma_map_single";
-	"pci_map_single";
-        "printk";
-        "memcpy";
-        "memzero";
-        "kmalloc";
-    ];;
+  let funcs_with_cont_return : (string, unit) Hashtbl.t = Hashtbl.create 63;;
 
-let mem_mgmt_fns string list =
-    [     "kmalloc";
-          "kmem_alloc";
-          "kfree";
-          "kcalloc";  
-          "kzalloc"; 
-          "kmem_cache_create";
-          "kmem_cache_alloc";
-          "kmem_cache_shrink";
-          "kmem_cache_free";
-          "vmalloc";
-          "vfree";
-    ];; 
-
-let dma_bad_third_argument: string list = 
-    [   "dma_alloc_coherent";
-        "dma_pool_alloc";
-        "dma_pool_free";
-    ];;
-
-let dma_bad_second_argument: string list =
-    [   "dma_map_single";
-        "dma_sync_single_for_cpu"; 
-        "dma_sync_single_for_device";
-    ];;
-
-let dma_bad_fourth_argument: string list =
-    [   "dma_free_coherent";
-    ];;
-  
+(* An empty name set, for classifier queries without per-function names. *)
+  let no_names : (string, unit) Hashtbl.t = Hashtbl.create 1;;
+   
 
 (* Auxilary helper functions  *)
  (* Printing the name of an lval *)
@@ -249,9 +116,15 @@ let dma_bad_fourth_argument: string list =
 
 
 
+(* Counted on every call, so held rather than looked up. Lazy, as main
+ * resets the counters after the modules are initialized. *)
+let exp_to_string_calls = lazy (Stats.counter "carb exp_to_string calls");;
+let statements_visited = lazy (Stats.counter "carb statements visited");;
+
 (* Converts an exp to a string *)
  let exp_to_string (e: exp) : string =
    begin
+     incr (Lazy.force exp_to_string_calls);
      (Pretty.sprint 100 (d_exp() e))
    end
 
@@ -303,93 +176,49 @@ let offset_to_string (o: offset) : string =
    end
                         
 
-(* Compare input string to check if its a bad function *)
-   let isbad (str : string) (sl: string list): int =
-   begin
-
-     let rc = ref 0 in
-     for i = 0 to (List.length bad_functions) - 1 do
-        let bad_string = (List.nth bad_functions i) in
-          if (String.compare bad_string str = 0) then
-            rc := 1;
-     done;
-
-     for i = 0 to (List.length sl) - 1 do
-         let bad_string = (List.nth sl i) in
-         if (String.compare bad_string str = 0) then
-             rc := 1;
-     done;
-
-     for i = 0 to (List.length !funcs_with_cont_return) - 1 do
-         let bad_string = (List.nth !funcs_with_cont_return i) in
-         if (String.compare bad_string str = 0) then
-             rc := 1;
-     done;
-
-     !rc
-   end
-  
-
+(* Compare input string to check if its a bad function. sl holds the
+ * per-function names known to carry device values. *)
+   let isbad (str : string) (sl: (string, unit) Hashtbl.t): int =
+     if (Devsigs.is_source str) || (Hashtbl.mem sl str)
+        || (Hashtbl.mem funcs_with_cont_return str) then 1 else 0
 
 (* Compare input string to check if its a contaminated function used for array
- * indexing analysis. *)
-   let iscontaminated (str : string) (sl: string list): int =
-   begin
+ * indexing analysis. Contaminating functions are the device sources. *)
+   let iscontaminated (str : string) (sl: (string, unit) Hashtbl.t): int =
+     isbad str sl
 
-     let rc = ref 0 in
-(*     for i = 0 to (List.length bad_memory_ptrs) - 1 do
-        let bad_string = (List.nth bad_memory_ptrs i) in
-        Changed on 01/07/2009 to since bad_memory_ptrs is 
-        a subset of bad_functions.
-        *)
-
-        for i = 0 to (List.length bad_functions) - 1 do
-         let bad_string = (List.nth bad_functions i) in
-          if (String.compare bad_string str = 0) then
-            rc := 1;
-     done;
+ (* Compare input string to check if its a halting function *)
+   let ishalting (str : string) : int =
+     if (Devsigs.is_halting str) then 1 else 0
 
-     for i = 0 to (List.length sl) - 1 do
-         let bad_string = (List.nth sl i) in
-         if (String.compare bad_string str = 0) then
-             rc := 1;
-     done;
+  (* Compare input string to check if its a DMA function *)
+    let isdmacall (str : string) : int =
+     if (Devsigs.is_sink str) then 1 else 0
 
-     for i = 0 to (List.length !funcs_with_cont_return) - 1 do
-         let bad_string = (List.nth !funcs_with_cont_return i) in
-         if (String.compare bad_string str = 0) then
-             rc := 1;
-     done;
+(* The name of the function a call names directly, "" for calls through
+ * pointers *)
+let call_name (e: exp) : string =
+  match e with
+  | Lval(Var(fv), NoOffset) -> fv.vname
+  | _ -> ""
 
-     !rc
-   end
+(* The variable an expression reads, through casts *)
+let rec exp_var_name (e: exp) : string option =
+  match e with
+  | Lval(Var(vi), NoOffset) -> Some vi.vname
+  | CastE(_, e1) -> exp_var_name e1
+  | _ -> None
 
+(* Loop counters are found by name. A counter that is not a variable matches
+ * no loop condition. *)
+let counter_name (e: exp) : string =
+  match exp_var_name e with
+  | Some name -> name
+  | None -> "?"
 
- (* Compare input string to check if its a halting function *)
-   let ishalting (str : string) : int =
-    begin
-      let rc = ref 0 in
-        for i = 0 to (List.length halting_fns) - 1 do
-          let halt_string = (List.nth halting_fns i) in
-            if
-              (String.compare halt_string str = 0) then
-            rc := 1;
-        done;
-        !rc
-    end
+let is_jiffies (e: exp) : bool = (exp_var_name e = Some "jiffies")
 
-  (* Compare input string to check if its a DMA function *)
-    let isdmacall (str : string) : int =
-     begin
-      let rc = ref 0 in
-        for i = 0 to (List.length dma_bad_functions) - 1 do 
-          let dma_string = (List.nth dma_bad_functions i) in
-            if
-              (String.compare dma_string str = 0) then
-             rc := 1;
-        done;
-        !rc
-     end
+let is_one (e: exp) : bool = (isInteger e = Some Int64.one)
 
 
 
@@ -399,284 +228,2600 @@ let offset_to_string (o: offset) : string =
 (*********Auxilary helper functions end ***********)
 
 
+(* Keys for the taint tables. An expression is reduced to a structural key
+ * built from variable ids, field names and constants, so the tables hash and
+ * compare plain data instead of pretty-printing every expression they see.
+ * Casts are transparent. A table key pairs the expression key with the vid of
+ * the function it belongs to.
+ *)
+type ekey =
+    KConst of int64
+  | KStr of string
+  | KOpaque of int
+  | KLval of lkey
+  | KAddrOf of lkey
+  | KStartOf of lkey
+  | KSizeOf of ekey
+  | KAlignOf of ekey
+  | KSizeOfT of typsig
+  | KAlignOfT of typsig
+  | KUnOp of unop * ekey
+  | KBinOp of binop * ekey * ekey
+and lkey = hkey * okey
+and hkey =
+    KVar of int
+  | KMem of ekey
+and okey =
+    KNoOffset
+  | KField of int * string * okey
+  | KIndex of ekey * okey
+
+type tkey = ekey * int
+
+let rec key_of_exp (e: exp) : ekey =
+  match e with
+  | Const(CInt64(i, _, _)) -> KConst i
+  | Const(CChr(c)) -> KConst (Int64.of_int (Char.code c))
+  | Const(CStr(str)) -> KStr str
+  | Const(CEnum(_, name, _)) -> KStr name
+  | Const(_) -> KOpaque 0
+  | Lval(lv) -> KLval (key_of_lval lv)
+  | SizeOf(t) -> KSizeOfT (typeSig t)
+  | AlignOf(t) -> KAlignOfT (typeSig t)
+  | SizeOfStr(str) -> KSizeOf (KStr str)
+  | SizeOfE(e1) -> KSizeOf (key_of_exp e1)
+  | AlignOfE(e1) -> KAlignOf (key_of_exp e1)
+  | UnOp(op, e1, _) -> KUnOp(op, key_of_exp e1)
+  | BinOp(op, e1, e2, _) -> KBinOp(op, key_of_exp e1, key_of_exp e2)
+  | CastE(_, e1) -> key_of_exp e1
+  | AddrOf(lv) -> KAddrOf (key_of_lval lv)
+  | StartOf(lv) -> KStartOf (key_of_lval lv)
+
+and key_of_lval ((host, off): lval) : lkey =
+  let hk = match host with
+    | Var(vi) -> KVar vi.vid
+    | Mem(e) -> KMem (key_of_exp e)
+  in
+  (hk, key_of_offset off)
+
+and key_of_offset (o: offset) : okey =
+  match o with
+  | NoOffset -> KNoOffset
+  | Field(fi, o1) -> KField(fi.fcomp.ckey, fi.fname, key_of_offset o1)
+  | Index(e, o1) -> KIndex(key_of_exp e, key_of_offset o1)
+
+(* The key of a plain variable. Equal to the key of Lval(Var v, NoOffset). *)
+let var_key (v: varinfo) : ekey = KLval(KVar v.vid, KNoOffset)
+
+let var_tkey (v: varinfo) (f: fundec) : tkey = (var_key v, f.svar.vid)
+
+let exp_tkey (e: exp) (f: fundec) : tkey = (key_of_exp e, f.svar.vid)
+
 (* Dirty variable hashtable for checking liveness. These variables are marked
  * dirty for the scope of the function. We can also limit them to the scope of a
- * block but dirtyness usually spans across blocks.
+ * block but dirtyness usually spans across blocks. The value is the device
+ * expression that made the variable dirty.
  * *)
 
-let dirrrty : (string*string, string) Hashtbl.t = (Hashtbl.create 15);;
-
-let when_dirrrty :(string*string, int) Hashtbl.t = (Hashtbl.create 15);;
+let dirrrty : (tkey, exp) Hashtbl.t = (Hashtbl.create 15);;
 
-(* To check if pointers have already been checked before *)
-let hist_dirty : (string*string, string) Hashtbl.t = (Hashtbl.create 15);;
+let when_dirrrty :(tkey, int) Hashtbl.t = (Hashtbl.create 15);;
 
 (* To check if arrays have already been checked before *)
-let hist_array_dirty : (string*string, string) Hashtbl.t = (Hashtbl.create 15);;
+let hist_array_dirty : (tkey, unit) Hashtbl.t = (Hashtbl.create 15);;
 
 (* To to npd analysis *)
-let ptr_seen_before : (string*string, string) Hashtbl.t = (Hashtbl.create 15);;
-
-(* To check if a pointer has already been checked against null *)
-let hist_if_ptr_check : (string*string, int) Hashtbl.t = (Hashtbl.create 15);;
+let ptr_seen_before : (tkey, unit) Hashtbl.t = (Hashtbl.create 15);;
 
 (* To check if an infinite loop has untainted a tainted variable. *)
-let hist_infinite_dirty : (string*string, string) Hashtbl.t = (Hashtbl.create 15);;
+let hist_infinite_dirty : (tkey, unit) Hashtbl.t = (Hashtbl.create 15);;
 
 (* Contaminated addresses/variables coming from a device. May not be used for 
  * array indexing etc.
  *)
-let contaminated : (string*string, string) Hashtbl.t =(Hashtbl.create 15);;
+let contaminated : (tkey, exp) Hashtbl.t =(Hashtbl.create 15);;
 
 let locateexplist: (block ref, exp list) Hashtbl.t =(Hashtbl.create 15);; 
 
-(* The initial visitor for preprocessing. Fills the dirrty and contaminated hash
- * table in this pre-scan step. *)
-class initialVisitor = object (self) 
-    inherit nopCilVisitor
+(*********** Findings ***********)
 
- val mutable curr_func : fundec = emptyFunction "temp";
- val mutable block_count = ref 0;
-(* Temporary list on a per-function basis to check variables that point to bad
- * functions.
+(* One bug found by driverVisitor. With --carb-findings, the findings of a
+ * run are appended to a file as JSON Lines, one object per finding, e.g.
+ *
+ *   {"category":"infinite_loop","file":"drivers/net/e1000/e1000_hw.c",
+ *    "function":"e1000_reset_hw","line":412,"source":"readl","fix":"ticks",
+ *    "cost_us":0}
+ *
+ * (on one line). The keys are always in this order.
  *)
- val mutable temp_bad_functions: string list =
-     [
-     ];
+type finding = {
+  fi_category: string;  (* infinite_loop, missing_timeout_report, ... *)
+  fi_file: string;
+  fi_function: string;
+  fi_line: int;         (* -1 when CIL has no line *)
+  fi_source: string;    (* The device value or access involved, "" if none *)
+  fi_fix: string;       (* The code added, "none" if only reported *)
+  fi_cost_us: int;      (* The estimated CPU time it costs (busy waits,
+                         * redundant reads, handlers), 0 if none *)
+}
+
+(* The findings so far, newest first *)
+let findings : finding list ref = ref [];;
+let num_findings : int ref = ref 0;;
+
+let add_finding (fi: finding) : unit =
+  findings := fi :: !findings;
+  incr num_findings
+
+(* The findings added after the first n, oldest first *)
+let findings_since (n: int) : finding list =
+  let rec take k l acc =
+    if k <= 0 then acc
+    else match l with
+    | [] -> acc
+    | fi :: rest -> take (k - 1) rest (fi :: acc)
+  in
+  take (!num_findings - n) !findings []
+
+let findings_file : string ref = ref "";;
+
+(* The estimated cost of one register read, in the findings of redundant
+ * device reads (--carb-mmio-cost) *)
+let mmio_cost_ns : int ref = ref 1000;;
+
+let json_string (buf: Buffer.t) (s: string) : unit =
+  Buffer.add_char buf '"';
+  String.iter
+    (fun c ->
+      match c with
+      | '"' -> Buffer.add_string buf "\\\""
+      | '\\' -> Buffer.add_string buf "\\\\"
+      | '\n' -> Buffer.add_string buf "\\n"
+      | '\t' -> Buffer.add_string buf "\\t"
+      | c when Char.code c < 0x20 ->
+          Buffer.add_string buf (Printf.sprintf "\\u%04x" (Char.code c))
+      | c -> Buffer.add_char buf c)
+    s;
+  Buffer.add_char buf '"'
+
+let json_finding (buf: Buffer.t) (fi: finding) : unit =
+  Buffer.add_string buf "{\"category\":";
+  json_string buf fi.fi_category;
+  Buffer.add_string buf ",\"file\":";
+  json_string buf fi.fi_file;
+  Buffer.add_string buf ",\"function\":";
+  json_string buf fi.fi_function;
+  Buffer.add_string buf (Printf.sprintf ",\"line\":%d,\"source\":" fi.fi_line);
+  json_string buf fi.fi_source;
+  Buffer.add_string buf ",\"fix\":";
+  json_string buf fi.fi_fix;
+  Buffer.add_string buf (Printf.sprintf ",\"cost_us\":%d}\n" fi.fi_cost_us)
+
+(* Append the findings to the findings file through one buffered channel.
+ * Concurrent runs should use a file each (see scripts/scan_tree.pl). *)
+let write_findings (l: finding list) : unit =
+  if !findings_file <> "" then begin
+    let oc =
+      try open_out_gen [Open_wronly; Open_creat; Open_append; Open_text]
+            0o644 !findings_file
+      with Sys_error msg ->
+        Errormsg.s (Errormsg.error "Cannot open findings file %s" msg)
+    in
+    let buf = Buffer.create 256 in
+    List.iter
+      (fun fi ->
+        Buffer.clear buf;
+        json_finding buf fi;
+        Buffer.output_buffer oc buf)
+      l;
+    close_out oc
+  end
 
- val mutable temp_cont_functions: string list =
-     [
-     ];
+(*********** Phase accounting ***********)
+
+(* The phases of the analysis are timed with Stats (see --stats). With
+ * --carb-bench, the wall time and the allocation of each phase are also
+ * printed on stderr, one "carb-bench" line per phase, for
+ * scripts/bench/run_bench.pl. *)
+let bench_output : bool ref = ref false;;
+
+(* Name, wall time, words allocated, minor and major collections *)
+let bench_phases : (string * float * float * int * int) list ref = ref [];;
+
+let carb_phase (name: string) (f: 'a -> 'b) (x: 'a) : 'b =
+  if not !bench_output then Stats.time name f x
+  else begin
+    let g0 = Gc.quick_stat () in
+    let t0 = Unix.gettimeofday () in
+    let r = Stats.time name f x in
+    let t1 = Unix.gettimeofday () in
+    let g1 = Gc.quick_stat () in
+    let words (g: Gc.stat) = g.Gc.minor_words +. g.Gc.major_words -. g.Gc.promoted_words in
+    bench_phases :=
+      (name, t1 -. t0, words g1 -. words g0,
+       g1.Gc.minor_collections - g0.Gc.minor_collections,
+       g1.Gc.major_collections - g0.Gc.major_collections) :: !bench_phases;
+    r
+  end
 
-   
- (* Finds all the call lvals (variables) in a CIL instruction. *)
-   method find_lvals_instr (i: instr) : lval list =
-   begin
-    match i with
-        | Call(lval_option,exp, exp_list,  _) ->
-          begin
-            match lval_option with
-            | Some (lval) -> lval :: [];
-            | _   -> [];
-          end
-        | Set (lval, exp, _) ->
-                lval::[];
-        | _ -> [];
-   end
+let print_bench_phases () : unit =
+  if !bench_output then begin
+    List.iter
+      (fun (name, wall, words, minor, major) ->
+        Printf.fprintf stderr
+          "carb-bench %s wall=%.3f alloc_mw=%.2f minor=%d major=%d\n"
+          name wall (words /. 1e6) minor major)
+      (List.rev !bench_phases);
+    Printf.fprintf stderr "carb-bench total heap_mw=%.2f\n"
+      (float_of_int (Gc.quick_stat ()).Gc.top_heap_words /. 1e6);
+    flush stderr
+  end
 
-   method find_lvals_exp (e: exp) : lval list =
-   begin
+(* With --carb-stats-json, the timings and counters of --stats are also
+ * written to a file as JSON, at exit so the total of the feature is in.
+ * The workers of --carb-jobs exit through the same handlers and leave the
+ * file alone. *)
+let set_stats_json (fname: string) : unit =
+  let oc =
+    try open_out fname
+    with Sys_error msg -> Errormsg.s (Errormsg.error "Cannot open %s" msg)
+  in
+  let owner = Unix.getpid () in
+  Stats.countCalls := true;
+  at_exit (fun () ->
+    if Unix.getpid () = owner then begin
+      Stats.print_json oc;
+      close_out oc
+    end)
+
+(*********** Alias analysis ***********)
+
+(* With --carb-alias, device values are followed through stores and loads
+ * of pointers. Ptranal is built on its one-level-flow backend: "unify" runs
+ * its unification mode (no subtyping), "golf" its subtyping mode. The
+ * analysis of the file runs at the first query, so with "none" (the default)
+ * or without pointer stores of device values it costs nothing. *)
+type alias_tier = AliasNone | AliasUnify | AliasGolf
+
+let alias_tier : alias_tier ref = ref AliasNone;;
+
+(* The file being checked, for the first query *)
+let alias_file : file option ref = ref None;;
+
+let alias_ready : bool ref = ref false;;
+
+(* Ptranal keeps its constraints for the life of the process, so only one
+ * file is analyzed per process (cilly --server refuses --carb-alias) *)
+let alias_ran : bool ref = ref false;;
+
+let set_alias_tier (name: string) : unit =
+  alias_tier :=
+    (match name with
+    | "none" -> AliasNone
+    | "unify" -> AliasUnify
+    | "golf" -> AliasGolf
+    | _ -> Errormsg.s (Errormsg.error
+             "Unknown alias analysis %s (none, unify or golf)" name))
+
+let alias_enabled () : bool = !alias_tier <> AliasNone
+
+(* Run the analysis if needed. False if there is none. *)
+let ensure_alias () : bool =
+  match !alias_tier, !alias_file with
+  | AliasNone, _ | _, None -> false
+  | tier, Some f ->
+      if not !alias_ready then begin
+        if !alias_ran then
+          Errormsg.s (Errormsg.error "--carb-alias analyzes one file per process");
+        alias_ready := true;
+        alias_ran := true;
+        Ptranal.no_sub := (tier = AliasUnify);
+        Ptranal.analyze_mono := true;
+        Ptranal.smart_aliases := false;
+        carb_phase "carb-alias" Ptranal.analyze_file f;
+        Ptranal.compute_results false
+      end;
+      true
+
+(* The variables an lval through a pointer may name *)
+let pointees (lv: lval) : varinfo list =
+  match lv with
+  | (Mem _, _) when ensure_alias () ->
+      (try Ptranal.resolve_lval lv
+       with Ptranal.UnknownLocation | Not_found -> [])
+  | _ -> []
+
+(* Variables given a device value through a pointer, by vid, with the value
+ * and where it was stored. They are tainted in every function. *)
+let stored_taint : (int, varinfo * exp * location) Hashtbl.t =
+  Hashtbl.create 15;;
+
+(* Formals given a device value by a caller, by the vid of the function and
+ * the position of the formal, with the argument and the call location *)
+let formal_taint : (int * int, exp * location) Hashtbl.t = Hashtbl.create 31;;
+
+(* The positions of the tainted formals of f *)
+let tainted_formal_positions (f: fundec) : int list =
+  let rec positions (n: int) (formals: varinfo list) : int list =
+    match formals with
+    | [] -> []
+    | _ :: rest ->
+        if Hashtbl.mem formal_taint (f.svar.vid, n) then n :: positions (n + 1) rest
+        else positions (n + 1) rest
+  in
+  positions 0 f.sformals
+
+(* What the alias analysis contributes to a result *)
+let alias_key () : string =
+  match !alias_tier with
+  | AliasNone -> "none"
+  | tier ->
+      let names = Hashtbl.fold (fun _ (vi, _, _) l -> vi.vname :: l) stored_taint [] in
+      String.concat " "
+        ((if tier = AliasGolf then "golf" else "unify")
+         :: List.sort compare names)
+
+(*********** Polling guards ***********)
+
+(* The guard added to an infinite polling loop. "count" gives up after
+ * tickval_exp iterations. "time" gives up once a budget in milliseconds is
+ * spent, and only reads jiffies every guard_interval iterations, so a fast
+ * loop pays a decrement and a test per iteration. Like the counter, the
+ * deadline is armed once per call of the function. *)
+type guard_mode = GuardCount | GuardTime
+
+let guard_mode : guard_mode ref = ref GuardCount;;
+
+let guard_interval : int ref = ref 64;;
+
+let guard_budget_ms : int ref = ref 1000;;
+
+(* (function, loop line) -> (interval, budget), from --carb-guard-loop *)
+let guard_overrides : (string * int, int * int) Hashtbl.t = Hashtbl.create 7;;
+
+(* jiffies and msecs_to_jiffies, once declared in the file *)
+let guard_globals : (varinfo * varinfo) option ref = ref None;;
+
+let set_guard_mode (name: string) : unit =
+  guard_mode :=
+    (match name with
+    | "count" -> GuardCount
+    | "time" -> GuardTime
+    | _ -> Errormsg.s (Errormsg.error "Unknown guard %s (count or time)" name))
+
+let positive (what: string) (s: string) : int =
+  let n = try int_of_string s with Failure _ -> 0 in
+  if n < 1 then Errormsg.s (Errormsg.error "Bad %s %s" what s);
+  n
+
+(* FUNC:LINE:INTERVAL:MS *)
+let add_guard_override (spec: string) : unit =
+  match Str.split (Str.regexp ":") spec with
+  | [fname; line; interval; ms] ->
+      Hashtbl.replace guard_overrides (fname, positive "line" line)
+        (positive "interval" interval, positive "budget" ms)
+  | _ -> Errormsg.s (Errormsg.error
+           "Bad loop guard %s (expected FUNC:LINE:INTERVAL:MS)" spec)
+
+(* What the guard settings contribute to a result *)
+let guard_key () : string =
+  match !guard_mode with
+  | GuardCount -> "count"
+  | GuardTime -> "time"
+
+let guard_params (fname: string) (line: int) : int * int =
+  try Hashtbl.find guard_overrides (fname, line)
+  with Not_found -> (!guard_interval, !guard_budget_ms)
+
+(* The global of the file with this name, declared with t if there is none *)
+let find_or_declare_global (f: file) (name: string) (t: typ) : varinfo =
+  let found = ref None in
+  iterGlobals f
+    (fun g ->
+      match g, !found with
+      | (GVarDecl(vi, _) | GVar(vi, _, _)), None when vi.vname = name ->
+          found := Some vi
+      | GFun(fd, _), None when fd.svar.vname = name -> found := Some fd.svar
+      | _ -> ());
+  match !found with
+  | Some vi -> vi
+  | None ->
+      let vi = makeGlobalVar name t in
+      vi.vstorage <- Extern;
+      f.globals <- GVarDecl(vi, locUnknown) :: f.globals;
+      vi
+
+let declare_guard_globals (f: file) : unit =
+  if !guard_mode = GuardTime then begin
+    let ulong = TInt(IULong, []) in
+    let jiffies = find_or_declare_global f "jiffies"
+        (TInt(IULong, [Attr("volatile", [])])) in
+    let to_jiffies = find_or_declare_global f "msecs_to_jiffies"
+        (TFun(ulong, Some [("m", TInt(IUInt, []), [])], false, [])) in
+    guard_globals := Some (jiffies, to_jiffies)
+  end
+
+(* The time guard of a loop, run at every iteration:
+ *
+ *   if (tick == 0) {
+ *     deadline = msecs_to_jiffies(ms); deadline = jiffies + deadline;
+ *     tick = interval;
+ *   } else if (--tick == 0) {
+ *     if ((long)(jiffies - deadline) >= 0) { fail }
+ *     tick = interval;
+ *   }
+ *)
+let time_guard (tick: varinfo) (deadline: varinfo) (interval: int) (ms: int)
+    (fail: stmt list) : stmt =
+  match !guard_globals with
+  | None -> Errormsg.s (Errormsg.bug "time guard without jiffies")
+  | Some (jiffies, to_jiffies) ->
+      let ulong = TInt(IULong, []) in
+      let tick_e = Lval(var tick) in
+      let deadline_e = Lval(var deadline) in
+      let jiffies_e = Lval(var jiffies) in
+      let rearm = Set(var tick, integer interval, locUnknown) in
+      let arm =
+        mkStmt (Instr [ Call(Some (var deadline), Lval(var to_jiffies),
+                             [integer ms], locUnknown);
+                        Set(var deadline,
+                            BinOp(PlusA, jiffies_e, deadline_e, ulong),
+                            locUnknown);
+                        rearm ]) in
+      let expired =
+        BinOp(Ge, CastE(TInt(ILong, []),
+                        BinOp(MinusA, jiffies_e, deadline_e, ulong)),
+              zero, intType) in
+      let check =
+        mkStmt (If(BinOp(Eq, tick_e, zero, intType),
+                   mkBlock [ mkStmt (If(expired, mkBlock fail, mkBlock [],
+                                        locUnknown));
+                             mkStmt (Instr [rearm]) ],
+                   mkBlock [], locUnknown)) in
+      let count =
+        mkStmt (Instr [Set(var tick, BinOp(MinusA, tick_e, one, intType),
+                           locUnknown)]) in
+      mkStmt (If(BinOp(Eq, tick_e, zero, intType), mkBlock [arm],
+                 mkBlock [count; check], locUnknown))
+
+(*********** Per-function summary cache ***********)
+
+(* With --carb-cache, the checks of driverVisitor are skipped for functions
+ * whose summary is in the cache. A summary is stored under a digest of the
+ * function body, the callees it relies on for taint and the signature
+ * database, so any of those changing is a miss. Lines are taken relative to
+ * the declaration of the function, so code added above it does not make a
+ * miss. The summary holds the checked body of the function, which replaces
+ * the parsed one on a hit, with its lines moved to where the function is now.
+ *)
+let cache_dir : string ref = ref "";;
+
+let cache_version = "carburizer-summary-9";;
+
+(* Bug counters of driverVisitor, or their change over one function. *)
+type finding_counts = {
+  fc_ticks: int;
+  fc_array_checks: int;
+  fc_deref_bugs: int;
+  fc_bad_ptr_lvals: int;
+  fc_ret_on_error: int;
+  fc_ret_pk: int;
+  fc_report_timeout: int;
+  fc_dma_taint: int;
+  fc_checks_dropped: int;
+  fc_checks_hoisted: int;
+  fc_mmio_reads: int;
+  fc_busy_waits: int;
+  fc_dma_syncs: int;
+  fc_dma_loop_maps: int;
+}
+
+let diff_counts (a: finding_counts) (b: finding_counts) : finding_counts =
+  { fc_ticks = a.fc_ticks - b.fc_ticks;
+    fc_array_checks = a.fc_array_checks - b.fc_array_checks;
+    fc_deref_bugs = a.fc_deref_bugs - b.fc_deref_bugs;
+    fc_bad_ptr_lvals = a.fc_bad_ptr_lvals - b.fc_bad_ptr_lvals;
+    fc_ret_on_error = a.fc_ret_on_error - b.fc_ret_on_error;
+    fc_ret_pk = a.fc_ret_pk - b.fc_ret_pk;
+    fc_report_timeout = a.fc_report_timeout - b.fc_report_timeout;
+    fc_dma_taint = a.fc_dma_taint - b.fc_dma_taint;
+    fc_checks_dropped = a.fc_checks_dropped - b.fc_checks_dropped;
+    fc_checks_hoisted = a.fc_checks_hoisted - b.fc_checks_hoisted;
+    fc_mmio_reads = a.fc_mmio_reads - b.fc_mmio_reads;
+    fc_busy_waits = a.fc_busy_waits - b.fc_busy_waits;
+    fc_dma_syncs = a.fc_dma_syncs - b.fc_dma_syncs;
+    fc_dma_loop_maps = a.fc_dma_loop_maps - b.fc_dma_loop_maps;
+  }
+
+(* The checked body of a function, as it is after driverVisitor, and the
+ * initializations of its tick counters. It is marshalled with the findings,
+ * so its variables and types are copies that relink_body binds back to the
+ * globals of the file being checked. cb_line is the line of the declaration
+ * of the function when it was stored. *)
+type cached_body = {
+  cb_line: int;
+  cb_formals: varinfo list;
+  cb_locals: varinfo list;
+  cb_body: block;
+  cb_maxid: int;
+  cb_tick_inits: stmt list;
+}
+
+(* The lines of fs_findings are relative to the declaration of the
+ * function *)
+type func_summary = {
+  fs_body: cached_body;
+  fs_counts: finding_counts;
+  fs_findings: finding list;
+}
+
+(* Digests of the function bodies as parsed, before prepareCFG renames the
+ * loop labels with file-wide counters. Keyed by the vid of the function. *)
+let body_digests : (int, string) Hashtbl.t = Hashtbl.create 63;;
+
+let sigs_digest = lazy (Devsigs.digest ());;
+
+(* Writes the shape of a function into a buffer: statement and instruction
+ * kinds, lines, labels, constants, operators, variable and field names and
+ * type signatures. Variable ids are left out, and the lines of decl.file are
+ * taken relative to decl, so the digest of a function does not change when
+ * the code around it does. *)
+class digestVisitor (buf: Buffer.t) (decl: location) = object
+  inherit nopCilVisitor
+  method add (tag: string) : unit =
+    Buffer.add_string buf tag;
+    Buffer.add_char buf ' '
+  method line (l: location) : string =
+    if l.line >= 0 && l.file = decl.file then string_of_int (l.line - decl.line)
+    else l.file ^ ":" ^ string_of_int l.line
+  method add_value : 'a. 'a -> unit = fun v ->
+    self#add (Digest.to_hex (Digest.string (Marshal.to_string v [])))
+
+  method vvdec (v: varinfo) : varinfo visitAction =
+    self#add ("decl " ^ v.vname);
+    DoChildren
+  method vvrbl (v: varinfo) : varinfo visitAction =
+    self#add (if v.vglob then "global " ^ v.vname else v.vname);
+    SkipChildren
+  method vstmt (s: stmt) : stmt visitAction =
+    List.iter (fun l ->
+        match l with
+        | Label(name, _, _) -> self#add ("label " ^ name)
+        | Case(_, _) -> self#add "case"
+        | Default(_) -> self#add "default") s.labels;
+    self#add (self#line (get_stmtLoc s.skind));
+    self#add (match s.skind with
+      | Instr(_) -> "instr"
+      | Return(_, _) -> "return"
+      | Goto(target, _) ->
+          (match !target.labels with
+           | Label(name, _, _) :: _ -> "goto " ^ name
+           | _ -> "goto")
+      | Break(_) -> "break"
+      | Continue(_) -> "continue"
+      | If(_, _, _, _) -> "if"
+      | Switch(_, _, _, _) -> "switch"
+      | Loop(_, _, _, _) -> "loop"
+      | Block(_) -> "block"
+      | TryFinally(_, _, _) -> "tryfinally"
+      | TryExcept(_, _, _, _) -> "tryexcept");
+    DoChildren
+  method vblock (b: block) : block visitAction =
+    self#add "{";
+    ChangeDoChildrenPost (b, (fun b -> self#add "}"; b))
+  method vinst (i: instr) : instr list visitAction =
+    (match i with
+     | Set(_, _, l) -> self#add ("set " ^ self#line l)
+     | Call(_, _, args, l) ->
+         self#add (Printf.sprintf "call/%d %s" (List.length args) (self#line l))
+     | Asm(_, tmpls, _, _, _, l) ->
+         self#add ("asm " ^ self#line l);
+         List.iter self#add tmpls);
+    DoChildren
+  method vexpr (e: exp) : exp visitAction =
     (match e with
-        | Const(c) ->
-                []; (* Constant *)
-        | Lval(l) -> (* Lvalue *)
-                l::[];
-        | SizeOf(s) ->
-            []; (* SizeOf(type) *)
-        | SizeOfE(e) ->
-            (* (self#analyze_exp e);  (* SizeOf(expression) *) *)
-             [];
-        | SizeOfStr(s) ->
-            []; (* SizeOfStr, as in sizeof ("strlit") *)
-        | AlignOf(t) ->
-            []; (* Corresponds to the GCC __alignof__ *)
-        | AlignOfE(e) ->
-            (* (self#analyze_exp e);*)
-             [];
-        | UnOp(op, e, t) ->          
-                (self#find_lvals_exp e); (* Unary operator, includes type of
-                result *)
-        | BinOp(b, e1, e2, t) ->
-            (* Binary operator, includes type of result *)
-            (List.append (self#find_lvals_exp e1) (self#find_lvals_exp e2));
-        | CastE(t, e) ->
-            (self#find_lvals_exp e); (* Cast *)
-        | AddrOf(l) ->
-            l::[]; (* Address of (lval) *)
-         | StartOf(l) ->
-            l::[]; (* Conversion from array to a pointer to the beginning of the
-            array *)
-        );
-   end        
-
-   method isbad_exp(e:exp) : int =
-    begin
-        let lvalue_list = ref [] in
-        let ret_val = ref 0 in
-        lvalue_list := self#find_lvals_exp e;
-            for i = 0 to (List.length !lvalue_list) -1 do
-                let lvalue = (List.nth !lvalue_list i) in
-                let (host, offset) = lvalue in
-                (match host with
-                | Var (vi) ->
-                        begin
-			    (* Printf.fprintf stderr "\n[Checking  vi.vname %s to add %s.]\n "  vi.vname (exp_to_string e); *)
-                            if (isbad vi.vname temp_bad_functions = 1) then
-                              begin
-                                (* If tmp=*bad()*, tmp is bad *)  
-                                temp_bad_functions <-
-                                    vi.vname::temp_bad_functions;
-                                 (* If tmp() { *bad()*} tmp is bad *)    
-                                temp_bad_functions <-
-                                    curr_func.svar.vname::temp_bad_functions;
-                                  Hashtbl.add dirrrty
-                                  (vi.vname,curr_func.svar.vname) (exp_to_string
-                                  e);
-                                  ret_val := 1;
-                              end
-                        end 
-                | _ -> ();
-                )
-            done;
-        !ret_val;
+     | Const(c) -> self#add_value c
+     | Lval(_) -> self#add "lval"
+     | SizeOf(_) -> self#add "sizeof"
+     | SizeOfE(_) -> self#add "sizeofe"
+     | SizeOfStr(str) -> self#add_value ("sizeofstr", str)
+     | AlignOf(_) -> self#add "alignof"
+     | AlignOfE(_) -> self#add "alignofe"
+     | UnOp(op, _, _) -> self#add_value op
+     | BinOp(op, _, _, _) -> self#add_value op
+     | CastE(_, _) -> self#add "cast"
+     | AddrOf(_) -> self#add "addrof"
+     | StartOf(_) -> self#add "startof");
+    DoChildren
+  method vlval (lv: lval) : lval visitAction =
+    (match lv with
+     | (Mem(_), _) -> self#add "mem"
+     | _ -> ());
+    DoChildren
+  method voffs (o: offset) : offset visitAction =
+    (match o with
+     | NoOffset -> ()
+     | Field(fi, _) -> self#add ("." ^ fi.fname)
+     | Index(_, _) -> self#add "[]");
+    DoChildren
+  method vtype (t: typ) : typ visitAction =
+    self#add_value (typeSig t);
+    SkipChildren
+end
+
+let record_body_digest (f: fundec) : unit =
+  let buf = Buffer.create 1024 in
+  ignore (visitCilFunction (new digestVisitor buf f.svar.vdecl) f);
+  Hashtbl.replace body_digests f.svar.vid (Digest.string (Buffer.contents buf))
+
+(* The names of the functions with a device return value that f calls *)
+let tainted_callees (f: fundec) : string list =
+  let names = ref [] in
+  List.iter
+    (fun s ->
+      match s.skind with
+      | Instr(il) ->
+          List.iter
+            (fun i ->
+              match i with
+              | Call(_, Lval(Var(fv), NoOffset), _, _)
+                when Hashtbl.mem funcs_with_cont_return fv.vname ->
+                  if not (List.mem fv.vname !names) then
+                    names := fv.vname :: !names
+              | _ -> ())
+            il
+      | _ -> ())
+    f.sallstmts;
+  List.sort compare !names
+
+let summary_path (f: fundec) : string option =
+  try
+    let body = Hashtbl.find body_digests f.svar.vid in
+    let key = String.concat "\n"
+        [ cache_version; body; f.svar.vdecl.file;
+          String.concat " " (tainted_callees f);
+          String.concat " " (List.map string_of_int (tainted_formal_positions f));
+          alias_key ();
+          guard_key ();
+          string_of_int !mmio_cost_ns;
+          string_of_bool (Hashtbl.mem isr_context f.svar.vid);
+          Lazy.force sigs_digest ] in
+    Some (Filename.concat !cache_dir (Digest.to_hex (Digest.string key)))
+  with Not_found -> None
+
+let load_summary (path: string) : func_summary option =
+  try
+    let ic = open_in_bin path in
+    let res =
+      try
+        let (version: string) = input_value ic in
+        if version = cache_version then
+          Some (input_value ic : func_summary)
+        else None
+      with End_of_file | Failure _ -> None
+    in
+    close_in ic;
+    res
+  with Sys_error _ -> None
+
+(* Write through a temporary file so concurrent runs never see a partial
+ * summary. *)
+let store_summary (path: string) (s: func_summary) : unit =
+  let tmp = Printf.sprintf "%s.%d.tmp" path (Unix.getpid ()) in
+  try
+    let oc = open_out_bin tmp in
+    output_value oc cache_version;
+    output_value oc s;
+    close_out oc;
+    Sys.rename tmp path
+  with Sys_error msg ->
+    ignore (Errormsg.warn "Cannot store summary %s: %s" path msg)
+
+let set_cache_dir (dir: string) : unit =
+  (try Unix.mkdir dir 0o755 with
+  | Unix.Unix_error(Unix.EEXIST, _, _) -> ()
+  | Unix.Unix_error(e, _, _) ->
+      Errormsg.s (Errormsg.error "Cannot create cache directory %s: %s"
+                    dir (Unix.error_message e)));
+  cache_dir := dir
+
+(* The globals, structs and typedefs of the file being checked, by name, to
+ * bind the copies in a cached body or in the body sent back by a worker
+ * (--carb-jobs) back to *)
+let cache_globals : (string, varinfo) Hashtbl.t = Hashtbl.create 127;;
+let cache_comps : (string, compinfo) Hashtbl.t = Hashtbl.create 31;;
+let cache_typedefs : (string, typeinfo) Hashtbl.t = Hashtbl.create 31;;
+let cache_enums : (string, enuminfo) Hashtbl.t = Hashtbl.create 31;;
+
+let index_cache_globals (f: file) : unit =
+  iterGlobals f
+    (fun g ->
+      match g with
+      | GFun(fd, _) -> Hashtbl.replace cache_globals fd.svar.vname fd.svar
+      | GVar(vi, _, _) | GVarDecl(vi, _) -> Hashtbl.replace cache_globals vi.vname vi
+      | GCompTag(ci, _) | GCompTagDecl(ci, _) -> Hashtbl.replace cache_comps ci.cname ci
+      | GType(ti, _) -> Hashtbl.replace cache_typedefs ti.tname ti
+      | GEnumTag(ei, _) | GEnumTagDecl(ei, _) -> Hashtbl.replace cache_enums ei.ename ei
+      | _ -> ())
+
+class relinkVisitor = object
+  inherit nopCilVisitor
+  method vvrbl (vi: varinfo) : varinfo visitAction =
+    if vi.vglob then
+      ChangeTo (try Hashtbl.find cache_globals vi.vname with Not_found -> vi)
+    else SkipChildren
+  method vtype (t: typ) : typ visitAction =
+    try
+      (match t with
+       | TComp(ci, a) -> ChangeTo (TComp(Hashtbl.find cache_comps ci.cname, a))
+       | TNamed(ti, a) -> ChangeTo (TNamed(Hashtbl.find cache_typedefs ti.tname, a))
+       | TEnum(ei, a) -> ChangeTo (TEnum(Hashtbl.find cache_enums ei.ename, a))
+       | _ -> DoChildren)
+    with Not_found -> DoChildren
+  method voffs (o: offset) : offset visitAction =
+    ChangeDoChildrenPost (o, (fun o ->
+      match o with
+      | Field(fi, o1) ->
+          (try Field(getCompField (Hashtbl.find cache_comps fi.fcomp.cname)
+                       fi.fname, o1)
+           with Not_found -> o)
+      | _ -> o))
+end
+
+(* Install a cached body into f and return its tick initializations. The
+ * locals of the body get fresh ids, the globals and types it uses are bound
+ * to those of the file by name. *)
+(* Moves the locations of file by delta lines *)
+class shiftLinesVisitor (file: string) (delta: int) = object
+  inherit nopCilVisitor
+  method shift (l: location) : location =
+    if l.line >= 0 && l.file = file then { l with line = l.line + delta }
+    else l
+  method vstmt (s: stmt) : stmt visitAction =
+    s.labels <- List.map (fun l ->
+        match l with
+        | Label(name, l, b) -> Label(name, self#shift l, b)
+        | Case(e, l) -> Case(e, self#shift l)
+        | Default(l) -> Default(self#shift l)) s.labels;
+    s.skind <- (match s.skind with
+      | Instr(_) | Block(_) -> s.skind
+      | Return(e, l) -> Return(e, self#shift l)
+      | Goto(target, l) -> Goto(target, self#shift l)
+      | Break(l) -> Break(self#shift l)
+      | Continue(l) -> Continue(self#shift l)
+      | If(e, b1, b2, l) -> If(e, b1, b2, self#shift l)
+      | Switch(e, b, cases, l) -> Switch(e, b, cases, self#shift l)
+      | Loop(b, l, s1, s2) -> Loop(b, self#shift l, s1, s2)
+      | TryFinally(b1, b2, l) -> TryFinally(b1, b2, self#shift l)
+      | TryExcept(b1, h, b2, l) -> TryExcept(b1, h, b2, self#shift l));
+    DoChildren
+  method vinst (i: instr) : instr list visitAction =
+    ChangeTo [(match i with
+      | Set(lv, e, l) -> Set(lv, e, self#shift l)
+      | Call(r, fn, args, l) -> Call(r, fn, args, self#shift l)
+      | Asm(a, tmpls, outs, ins, clob, l) ->
+          Asm(a, tmpls, outs, ins, clob, self#shift l))]
+end
+
+let relink_body (f: fundec) (cb: cached_body) : stmt list =
+  let v = new relinkVisitor in
+  let formals = List.map (visitCilVarDecl v) cb.cb_formals in
+  let locals = List.map (visitCilVarDecl v) cb.cb_locals in
+  List.iter (fun vi -> vi.vid <- newVID ()) (List.append formals locals);
+  setFormals f formals;
+  f.slocals <- locals;
+  f.sbody <- visitCilBlock v cb.cb_body;
+  f.smaxid <- cb.cb_maxid;
+  f.sallstmts <- [];
+  let inits = List.map (visitCilStmt v) cb.cb_tick_inits in
+  if f.svar.vdecl.line <> cb.cb_line then begin
+    let shift = new shiftLinesVisitor f.svar.vdecl.file
+        (f.svar.vdecl.line - cb.cb_line) in
+    f.sbody <- visitCilBlock shift f.sbody;
+    List.map (visitCilStmt shift) inits
+  end else inits
+
+(*********** Parallel analysis ***********)
+
+(* With --carb-jobs N, driverVisitor runs on the functions of the file in N
+ * forked workers. Each worker sees a copy of the converged taint tables and
+ * sends back its rewritten functions and findings, which are merged in file
+ * order. *)
+let carb_jobs : int ref = ref 1;;
+
+(* Index of the function in the file, the rewritten function, the change in
+ * the bug counters and the findings. *)
+type worker_result = int * fundec * finding_counts * finding list
+
+(* Binds the variables by remap, and the types like relinkVisitor *)
+class remapVisitor (remap: varinfo -> varinfo) = object
+  inherit relinkVisitor
+  method vvrbl (vi: varinfo) : varinfo visitAction = ChangeTo (remap vi)
+end
+
+(* Install the body computed by a worker into the parent's fundec. The
+ * unmarshalled body has its own copies of every variable and type, so the
+ * variables are bound back to the parent's varinfos by id and the structs,
+ * typedefs and enums by name (index_cache_globals). Variables with ids from
+ * fork_vid on were created by a worker. Workers allocate ids independently,
+ * so those get fresh ids here, and their types are bound too. *)
+let merge_worker_fundec (globals: (int, varinfo) Hashtbl.t) (fork_vid: int)
+    (fd: fundec) (w: fundec) : unit =
+  let locals = Hashtbl.create 31 in
+  List.iter (fun vi -> Hashtbl.replace locals vi.vid vi)
+    (List.append fd.sformals fd.slocals);
+  let fresh = Hashtbl.create 7 in
+  let remap (vi: varinfo) : varinfo =
+    if vi.vid < fork_vid then
+      (try Hashtbl.find locals vi.vid
+       with Not_found ->
+         (try Hashtbl.find globals vi.vid with Not_found -> vi))
+    else begin
+      Hashtbl.replace fresh vi.vid vi;
+      vi
     end
-        
+  in
+  let v = new remapVisitor remap in
+  let body = visitCilBlock v w.sbody in
+  fd.slocals <- List.map remap w.slocals;
+  Hashtbl.iter
+    (fun _ vi ->
+      ignore (visitCilVarDecl v vi);
+      vi.vid <- newVID ())
+    fresh;
+  fd.sbody <- body;
+  fd.smaxid <- w.smaxid;
+  fd.smaxstmtid <- w.smaxstmtid;
+  fd.sallstmts <- w.sallstmts
+
+(*********** Streaming ***********)
+
+(* With --carb-stream FILE, the checked program is written to FILE one global
+ * at a time, as driverVisitor goes. The taint tables then only hold the
+ * function being checked (compute_taint keeps the summaries, each function is
+ * tainted again right before its checks), and the body of a function is
+ * dropped once printed. The peak memory is the declarations and summaries of
+ * the module plus its largest function. *)
+let stream_file : string ref = ref "";;
+
+let stream_out : out_channel option ref = ref None;;
+
+let streaming () : bool = !stream_file <> ""
+
+(* The tables keyed by function, see tkey *)
+let clear_function_tables () : unit =
+  Hashtbl.clear dirrrty;
+  Hashtbl.clear when_dirrrty;
+  Hashtbl.clear contaminated;
+  Hashtbl.clear hist_array_dirty;
+  Hashtbl.clear ptr_seen_before;
+  Hashtbl.clear hist_infinite_dirty;
+  Hashtbl.clear locateexplist
+
+let open_stream () : unit =
+  if streaming () then begin
+    if !carb_jobs > 1 then
+      Errormsg.s (Errormsg.error "--carb-stream checks the functions in order, it cannot be used with --carb-jobs");
+    let oc =
+      try open_out !stream_file
+      with Sys_error msg -> Errormsg.s (Errormsg.error "Cannot open %s" msg)
+    in
+    (* As Cil.dumpFile *)
+    Pretty.printDepth := 99999;
+    Pretty.fastMode := true;
+    output_string oc ("/* Generated by CIL v. " ^ cilVersion ^ " */\n");
+    output_string oc ("/* print_CIL_Input is " ^
+                      (if !print_CIL_Input then "true" else "false") ^ " */\n\n");
+    stream_out := Some oc
+  end
 
-   method iscont_exp(e:exp) : int =
-        begin
-            let lvalue_list = ref [] in
-            let ret_val = ref 0 in
-            lvalue_list :=
-                self#find_lvals_exp e;
-                for i = 0 to (List.length !lvalue_list) -1 do
-                    let lvalue = (List.nth !lvalue_list i) in
-                    let (host, offset) = lvalue in
-                    (match host with
-                | Var (vi) ->
-                        begin
-                            if (iscontaminated vi.vname temp_cont_functions = 1) then
-                              begin
-                               (*   Printf.fprintf stderr "\nADDING to CONT: %s
-                              and %s\n" vi.vname curr_func.svar.vname; *)
-                                (* If tmp=*cont()*, tmp is cont *)
-                                temp_cont_functions <- vi.vname::temp_cont_functions;
-                                (* If * tmp() * { *bad()*} tmp is cont *)
-                                temp_cont_functions <- curr_func.svar.vname::temp_cont_functions;
-                                 Hashtbl.add contaminated (vi.vname,curr_func.svar.vname)
-                                      (exp_to_string e); 
-                                 ret_val := 1;
-                              end
-                        end
-                |_ -> ();
-                    )
-                done;
-                !ret_val;
-        end
+let print_streamed (g: global) : unit =
+  match !stream_out with
+  | Some oc -> dumpGlobal !printerForMaincil oc g
+  | None -> ()
+
+(* The bodies are gone once streamed: the file keeps prototypes, so printing
+ * it (--out) does not give empty functions. *)
+let close_stream (f: file) : unit =
+  match !stream_out with
+  | None -> ()
+  | Some oc ->
+      close_out oc;
+      stream_out := None;
+      f.globals <-
+        List.map (fun g ->
+            match g with
+            | GFun(fd, l) -> GVarDecl(fd.svar, l)
+            | _ -> g)
+          f.globals
+
+let drop_body (fd: fundec) : unit =
+  fd.sbody <- mkBlock [];
+  fd.slocals <- [];
+  fd.sallstmts <- [];
+  clear_function_tables ()
+
+(*********** Interprocedural taint engine ***********)
+
+module VS = Usedef.VS
+module CG = Callgraph
+
+(* Functions whose CFG has been prepared. prepareCFG is not idempotent, it
+ * wraps every loop again each time it runs. *)
+let cfg_ready : (int, unit) Hashtbl.t = Hashtbl.create 63;;
+
+let ensure_cfg (f: fundec) : unit =
+  if not (Hashtbl.mem cfg_ready f.svar.vid) then begin
+    prepareCFG f;
+    computeCFGInfo f false;
+    Hashtbl.add cfg_ready f.svar.vid ()
+  end
 
-   
-   (* Visits every "instruction" *)
-   method inst_process (i: instr) : unit =
-   begin
-       let lvalue_list = ref [] in
-        match i with 
-         Call(lvalue_option,e,el,loc) -> 
-        begin
+(* The variables whose value an expression carries. Variables only used to
+ * compute an address (under Mem or in an index) do not count. *)
+let rec taint_vars_of_exp (e: exp) : varinfo list =
+  match e with
+  | Lval(Var(vi), _) | AddrOf(Var(vi), _) | StartOf(Var(vi), _) -> [vi]
+  | UnOp(_, e1, _) | CastE(_, e1) -> taint_vars_of_exp e1
+  | BinOp(_, e1, e2, _) ->
+      List.append (taint_vars_of_exp e1) (taint_vars_of_exp e2)
+  | _ -> []
+
+(* The loads through a pointer whose value an expression carries *)
+let rec loads_of_exp (e: exp) : lval list =
+  match e with
+  | Lval((Mem _, _) as lv) -> [lv]
+  | UnOp(_, e1, _) | CastE(_, e1) -> loads_of_exp e1
+  | BinOp(_, e1, e2, _) -> List.append (loads_of_exp e1) (loads_of_exp e2)
+  | _ -> []
+
+let var_is_tainted (st: VS.t) (vi: varinfo) : bool =
+  (VS.mem vi st) || (Hashtbl.mem stored_taint vi.vid)
+
+(* An expression is tainted if it names a tainted variable, a device source
+ * or a function known to return a device value, or loads through a pointer
+ * to a tainted variable. Loads are only looked up if a variable that can be
+ * pointed to is tainted. *)
+let exp_is_tainted (st: VS.t) (e: exp) : bool =
+  List.exists (fun vi -> (var_is_tainted st vi) || (isbad vi.vname no_names = 1))
+    (taint_vars_of_exp e)
+  || ((Hashtbl.length stored_taint > 0
+       || VS.exists (fun vi -> vi.vaddrof || isArrayType vi.vtype) st)
+      && List.exists (fun lv -> List.exists (var_is_tainted st) (pointees lv))
+           (loads_of_exp e))
+
+(* The variables an instruction taints, with the expression that taints
+ * them. A store through a pointer taints what the pointer may point to. *)
+let tainted_defs (i: instr) (st: VS.t) : (varinfo * exp * location) list =
+  match i with
+  | Set((Var(vi), _), e, loc) when exp_is_tainted st e -> [(vi, e, loc)]
+  | Call(Some((Var(vi), _)), e, _, loc) when exp_is_tainted st e ->
+      [(vi, e, loc)]
+  | Set(((Mem _, _) as lv), e, loc) | Call(Some(((Mem _, _) as lv)), e, _, loc)
+    when exp_is_tainted st e ->
+      List.map
+        (fun vi ->
+          Hashtbl.replace stored_taint vi.vid (vi, e, loc);
+          (vi, e, loc))
+        (pointees lv)
+  | _ -> []
+
+(* Forward propagation of device values within one function. The state is
+ * the set of tainted variables. It only grows, so a join is a union. *)
+module TaintFlow = struct
+  let name = "carburizer taint"
+  let debug = ref false
+  type t = VS.t
+  let copy (st: t) : t = st
+  let stmtStartData : t Inthash.t = Inthash.create 64
+  let pretty () (st: t) : doc =
+    dprintf "{%a}" (d_list ", " (fun () vi -> text vi.vname)) (VS.elements st)
+  let computeFirstPredecessor (s: stmt) (st: t) : t = st
+  let combinePredecessors (s: stmt) ~(old: t) (st: t) : t option =
+    if VS.subset st old then None else Some (VS.union old st)
+  let doInstr (i: instr) (st: t) : t Dataflow.action =
+    match tainted_defs i st with
+    | [] -> Dataflow.Default
+    | defs ->
+        Dataflow.Done (List.fold_left (fun st (vi, _, _) -> VS.add vi st) st defs)
+  let doStmt (s: stmt) (st: t) : t Dataflow.stmtaction = Dataflow.SDefault
+  let doGuard (e: exp) (st: t) : t Dataflow.guardaction = Dataflow.GDefault
+  let filterStmt (s: stmt) : bool = true
+end
 
-              lvalue_list := self#find_lvals_instr i;
-             (* Printf.fprintf stderr "::Called for %s (%s).\n" (instr_to_string i) 
-            (exp_to_string e); *) 
-            for i = 0 to (List.length !lvalue_list) - 1 do
-                let lvalue = (List.nth !lvalue_list i) in
-                let (host, offset) = lvalue in
-                (match host with
-                | Var  (vi) ->
-                        begin
-                        (* Printf.fprintf stderr
-                        "DIRTY CHECK:Call found with exp %s which is %d with var %s" (exp_to_string e)
-                        (isbad (exp_to_string e) temp_bad_functions) vi.vname;
-                        *)
-                        if (self#isbad_exp e  = 1) then
-                            begin
-                                temp_bad_functions <-
-                                    vi.vname::temp_bad_functions;
- 	                             (*   Printf.fprintf stderr "Adding TO BAD: %s %d.\n"
-                                 vi.vname !block_count; *)
-                                Hashtbl.add dirrrty
-                                (vi.vname,curr_func.svar.vname) (exp_to_string e);
-				Hashtbl.add when_dirrrty (vi.vname, curr_func.svar.vname) loc.line;
-                            end;
-
-                       (*      Printf.fprintf stderr 
-                             "CONT CHECK:Call found with exp %s which is %d with var %s" (exp_to_string e)
-                             (iscontaminated (exp_to_string e) temp_cont_functions) vi.vname;
-			*)
-                        
-                        if (iscontaminated (exp_to_string e) temp_cont_functions  = 1) then
-                            begin
-                                temp_cont_functions <-
-                                    vi.vname::temp_cont_functions;
-                                Hashtbl.add contaminated
-                                (vi.vname,curr_func.svar.vname) (exp_to_string e);
-                            end;
-                        end
-                | _ -> ();
-                )
-            done;
+module TF = Dataflow.ForwardsDataFlow(TaintFlow)
+
+let add_taint (f: fundec) (vi: varinfo) (e: exp) (loc: location) : unit =
+  let key = var_tkey vi f in
+  Hashtbl.replace dirrrty key e;
+  Hashtbl.replace contaminated key e;
+  Hashtbl.replace when_dirrrty key loc.line
+
+(* The functions whose formals were tainted since the last call of
+ * taint_scc, by vid *)
+let new_formal_taints : int list ref = ref [];;
+
+(* Taint the formals of the callee that receive a tainted argument *)
+let taint_call_args (i: instr) (st: VS.t) : unit =
+  match i with
+  | Call(_, Lval(Var(fv), NoOffset), args, loc) ->
+      ignore
+        (List.fold_left
+           (fun n arg ->
+             if not (Hashtbl.mem formal_taint (fv.vid, n))
+                && exp_is_tainted st arg then begin
+               Hashtbl.add formal_taint (fv.vid, n) (arg, loc);
+               new_formal_taints := fv.vid :: !new_formal_taints
+             end;
+             n + 1)
+           0 args)
+  | _ -> ()
+
+(* Propagate taint through f and record the tainted variables of f in the
+ * taint tables. Returns true if f returns a device value. *)
+let taint_function (f: fundec) : bool =
+  ensure_cfg f;
+  (* The variables of f tainted through pointers elsewhere *)
+  List.iter
+    (fun vi ->
+      try
+        let (_, e, loc) = Hashtbl.find stored_taint vi.vid in
+        add_taint f vi e loc
+      with Not_found -> ())
+    (List.append f.sformals f.slocals);
+  Hashtbl.iter
+    (fun _ (vi, e, loc) -> if vi.vglob then add_taint f vi e loc)
+    stored_taint;
+  (* The formals tainted by callers *)
+  let seeds = ref VS.empty in
+  ignore
+    (List.fold_left
+       (fun n vi ->
+         (try
+           let (e, loc) = Hashtbl.find formal_taint (f.svar.vid, n) in
+           add_taint f vi e loc;
+           seeds := VS.add vi !seeds
+         with Not_found -> ());
+         n + 1)
+       0 f.sformals);
+  Inthash.clear TaintFlow.stmtStartData;
+  let tainted_return = ref false in
+  (match f.sbody.bstmts with
+  | [] -> ()
+  | first :: _ ->
+      Inthash.add TaintFlow.stmtStartData first.sid !seeds;
+      TF.compute [first];
+      List.iter
+        (fun s ->
+          match Inthash.tryfind TaintFlow.stmtStartData s.sid with
+          | None -> () (* Unreachable *)
+          | Some st ->
+              (match s.skind with
+              | Instr(il) ->
+                  ignore
+                    (List.fold_left
+                       (fun st i ->
+                         taint_call_args i st;
+                         List.fold_left
+                           (fun st (vi, e, loc) ->
+                             add_taint f vi e loc;
+                             VS.add vi st)
+                           st (tainted_defs i st))
+                       st il)
+              | Return(Some(e), _) ->
+                  if exp_is_tainted st e then tainted_return := true
+              | _ -> ()))
+        f.sallstmts);
+  !tainted_return
+
+(* The strongly connected components of the call graph restricted to the
+ * functions defined in the file, callees before callers (Tarjan). *)
+let call_sccs (cg: CG.callgraph) (f: file) (defined: (int, fundec) Hashtbl.t)
+    : fundec list list =
+  let index = Inthash.create 63 in
+  let lowlink = Inthash.create 63 in
+  let on_stack = Inthash.create 63 in
+  let stack = ref [] in
+  let counter = ref 0 in
+  let sccs = ref [] in
+  let fundec_of (n: CG.callnode) : fundec option =
+    match n.CG.cnInfo with
+    | CG.NIVar(vi, _) ->
+        (try Some (Hashtbl.find defined vi.vid) with Not_found -> None)
+    | CG.NIIndirect(_, _) -> None
+  in
+  let rec visit (n: CG.callnode) : unit =
+    let id = n.CG.cnid in
+    Inthash.replace index id !counter;
+    Inthash.replace lowlink id !counter;
+    incr counter;
+    stack := n :: !stack;
+    Inthash.replace on_stack id ();
+    Inthash.iter
+      (fun mid (m: CG.callnode) ->
+        match fundec_of m with
+        | None -> () (* External or indirect *)
+        | Some _ ->
+            if not (Inthash.mem index mid) then begin
+              visit m;
+              Inthash.replace lowlink id
+                (min (Inthash.find lowlink id) (Inthash.find lowlink mid))
+            end else if Inthash.mem on_stack mid then
+              Inthash.replace lowlink id
+                (min (Inthash.find lowlink id) (Inthash.find index mid)))
+      n.CG.cnCallees;
+    if Inthash.find lowlink id = Inthash.find index id then begin
+      let rec pop (acc: fundec list) : fundec list =
+        match !stack with
+        | [] -> acc
+        | m :: rest ->
+            stack := rest;
+            Inthash.remove on_stack m.CG.cnid;
+            let acc = (match fundec_of m with
+                       | Some fd -> fd :: acc
+                       | None -> acc) in
+            if m.CG.cnid = id then acc else pop acc
+      in
+      sccs := (pop []) :: !sccs
+    end
+  in
+  iterGlobals f
+    (fun g ->
+      match g with
+      | GFun(fd, _) ->
+          (try
+            let n = Hashtbl.find cg fd.svar.vname in
+            if not (Inthash.mem index n.CG.cnid) then visit n
+          with Not_found -> ())
+      | _ -> ());
+  List.rev !sccs
+
+(* Analyze one component until the tainted returns and formals of its
+ * functions stop changing. Taint only grows, so this terminates. *)
+let taint_scc (scc: fundec list) : unit =
+  let work = Queue.create () in
+  let queued = Hashtbl.create 7 in
+  let enqueue (fd: fundec) : unit =
+    if not (Hashtbl.mem queued fd.svar.vid) then begin
+      Hashtbl.add queued fd.svar.vid ();
+      Queue.add fd work
+    end
+  in
+  List.iter enqueue scc;
+  while not (Queue.is_empty work) do
+    let fd = Queue.take work in
+    Hashtbl.remove queued fd.svar.vid;
+    let tainted = taint_function fd in
+    if streaming () then clear_function_tables ();
+    (* Functions of the component given tainted arguments. Those of other
+     * components are analyzed again in the next pass of compute_taint. *)
+    List.iter
+      (fun vid -> List.iter (fun g -> if g.svar.vid = vid then enqueue g) scc)
+      !new_formal_taints;
+    new_formal_taints := [];
+    if tainted
+        && not (Hashtbl.mem funcs_with_cont_return fd.svar.vname) then begin
+      Hashtbl.replace funcs_with_cont_return fd.svar.vname ();
+      (* Callers within the component, fd itself if it is recursive, have
+       * to see the new summary. *)
+      List.iter enqueue scc
+    end
+  done
+
+(* Fills dirrrty, when_dirrrty, contaminated, funcs_with_cont_return and
+ * formal_taint for the whole file. Components are processed bottom-up, so
+ * every tainted return is final before the callers outside the component are
+ * analyzed; tainted arguments flow the other way, to the next pass. *)
+let compute_taint (f: file) : unit =
+  let defined = Hashtbl.create 63 in
+  iterGlobals f
+    (fun g ->
+      match g with
+      | GFun(fd, _) ->
+          Hashtbl.replace defined fd.svar.vid fd;
+          if !cache_dir <> "" then record_body_digest fd
+      | _ -> ());
+  let cg = CG.computeGraph f in
+  let sccs = call_sccs cg f defined in
+  alias_file := Some f;
+  (* Variables tainted through pointers are tainted everywhere, and device
+   * values passed as arguments taint the formals of callees analyzed
+   * earlier, so the pass is repeated until neither adds a variable. *)
+  let rec pass () =
+    let before = Hashtbl.length stored_taint + Hashtbl.length formal_taint in
+    List.iter taint_scc sccs;
+    if Hashtbl.length stored_taint + Hashtbl.length formal_taint > before
+    then pass ()
+  in
+  pass ()
+
+(*********** Report call summaries ***********)
+
+(* Whether each statement of the function being checked contains a call to a
+ * report function (printk, dev_warn, ..., see Devsigs.is_report), by statement
+ * id. Computed bottom-up once per function. Statements added by the rewrites
+ * have no id and are looked at directly, which is cheap since their nested
+ * blocks are mostly original statements. *)
+let stmt_reports : (int, bool) Hashtbl.t = Hashtbl.create 127;;
+
+(* The enclosing statement of each statement, by id *)
+let stmt_parent : (int, int) Hashtbl.t = Hashtbl.create 127;;
+
+let is_report_call (i: instr) : bool =
+  match i with
+  | Call(_, Lval(Var(fv), NoOffset), _, _) -> Devsigs.is_report fv.vname
+  | _ -> false
+
+let rec block_has_report (b: block) : bool =
+  List.exists stmt_has_report b.bstmts
+
+and stmt_has_report (s: stmt) : bool =
+  try Hashtbl.find stmt_reports s.sid
+  with Not_found ->
+    match s.skind with
+    | Instr(il) -> List.exists is_report_call il
+    | If(_, b1, b2, _) | TryFinally(b1, b2, _) | TryExcept(b1, _, b2, _) ->
+        block_has_report b1 || block_has_report b2
+    | Loop(b1, _, _, _) | Block(b1) | Switch(_, b1, _, _) -> block_has_report b1
+    | _ -> false
+
+(* Fill stmt_reports and stmt_parent for f. Needs the ids of computeCFGInfo. *)
+let summarize_reports (f: fundec) : unit =
+  Hashtbl.clear stmt_reports;
+  Hashtbl.clear stmt_parent;
+  let rec summarize_block (parent: int) (b: block) : bool =
+    List.fold_left
+      (fun found s -> let r = summarize_stmt parent s in found || r)
+      false b.bstmts
+  and summarize_stmt (parent: int) (s: stmt) : bool =
+    let r =
+      match s.skind with
+      | Instr(il) -> List.exists is_report_call il
+      | If(_, b1, b2, _) | TryFinally(b1, b2, _) | TryExcept(b1, _, b2, _) ->
+          let r1 = summarize_block s.sid b1 in
+          let r2 = summarize_block s.sid b2 in
+          r1 || r2
+      | Loop(b1, _, _, _) | Block(b1) | Switch(_, b1, _, _) ->
+          summarize_block s.sid b1
+      | _ -> false
+    in
+    if s.sid >= 0 then begin
+      Hashtbl.replace stmt_reports s.sid r;
+      if parent >= 0 then Hashtbl.replace stmt_parent s.sid parent
+    end;
+    r
+  in
+  ignore (summarize_block (-1) f.sbody)
+
+(* A report call was put in statement sid. Mark it and its enclosing
+ * statements. *)
+let rec mark_report_added (sid: int) : unit =
+  if not (try Hashtbl.find stmt_reports sid with Not_found -> false) then begin
+    Hashtbl.replace stmt_reports sid true;
+    try mark_report_added (Hashtbl.find stmt_parent sid) with Not_found -> ()
+  end
+
+(* A report call was put in b. Mark the statements enclosing b. *)
+let note_report_added (b: block) : unit =
+  try
+    let s = List.find (fun s -> s.sid >= 0) b.bstmts in
+    mark_report_added (Hashtbl.find stmt_parent s.sid)
+  with Not_found -> ()
+
+(*********** Natural loops ***********)
+
+(* A loop of the function CFG: a header and the statements that reach one of
+ * its back edges without going through the header. Loops are found from the
+ * dominators, so loops made of gotos (retry labels) are found like the
+ * syntactic ones. *)
+type nat_loop = {
+  nl_header: stmt;
+  nl_stmts: stmt list;            (* In statement id order, header included *)
+  nl_ids: (int, unit) Hashtbl.t;  (* The ids of nl_stmts *)
+  nl_exits: exp list;             (* Conditions under which the loop is left *)
+}
+
+(* The condition under which s branches to t *)
+let branch_condition (s: stmt) (t: stmt) : exp option =
+  let first (b: block) : int option =
+    match b.bstmts with
+    | first :: _ -> Some first.sid
+    | [] -> None
+  in
+  match s.skind with
+  | If(e, b1, b2, _) ->
+      (match first b1, first b2 with
+      | Some sid, _ when sid = t.sid -> Some e
+      | _, Some sid when sid = t.sid -> Some (UnOp(LNot, e, intType))
+      | None, _ -> Some e   (* The then branch falls through to t *)
+      | _, None -> Some (UnOp(LNot, e, intType))
+      | _ -> None)
+  | Switch(e, _, _, _) -> Some e
+  | _ -> None
+
+(* The natural loops of f by header id. Needs the ids of computeCFGInfo. *)
+let natural_loops (f: fundec) : nat_loop Inthash.t =
+  let loops = Inthash.create 13 in
+  let idoms = Dominators.computeIDom ~doCFG:false f in
+  List.iter
+    (fun (header, backs) ->
+      let ids = Hashtbl.create 31 in
+      Hashtbl.replace ids header.sid ();
+      let rec reach (work: stmt list) (acc: stmt list) : stmt list =
+        match work with
+        | [] -> acc
+        | s :: rest ->
+            if Hashtbl.mem ids s.sid then reach rest acc
+            else begin
+              Hashtbl.replace ids s.sid ();
+              reach (List.rev_append s.preds rest) (s :: acc)
+            end
+      in
+      let stmts =
+        List.sort (fun a b -> compare a.sid b.sid) (header :: reach backs [])
+      in
+      let exits =
+        List.fold_left
+          (fun acc s ->
+            List.fold_left
+              (fun acc t ->
+                if Hashtbl.mem ids t.sid then acc
+                else match branch_condition s t with
+                | Some e -> e :: acc
+                | None -> acc)
+              acc s.succs)
+          [] stmts
+      in
+      Inthash.replace loops header.sid
+        { nl_header = header; nl_stmts = stmts; nl_ids = ids;
+          nl_exits = List.rev exits })
+    (Dominators.findNaturalLoops f idoms);
+  loops
+
+(* Whether the loop is made of gotos: its header is not a Loop statement and
+ * has a label from the source (the labels of prepareCFG are not). *)
+let is_goto_loop (l: nat_loop) : bool =
+  match l.nl_header.skind with
+  | Loop _ -> false
+  | _ ->
+      List.exists
+        (fun lbl -> match lbl with Label(_, _, true) -> true | _ -> false)
+        l.nl_header.labels
+
+(*********** Redundant check elimination ***********)
+
+(* The inserted bounds and null checks return when one of their atoms
+ * (index < 0, index >= length, !pointer) holds. Each check is first moved up
+ * its block, past the assignments to locals it does not read, so it covers
+ * as much of the function as it can; calls, asms and stores stay ahead of
+ * it. A forward must-analysis then finds the atoms known to be false at each
+ * statement, from the checks before it and from the conditions of the driver
+ * itself. An atom index >= n is also known to be false after index >= m with
+ * m <= n was. Writes to a variable forget the atoms that read it; stores
+ * through pointers and calls forget the atoms that read memory, globals or
+ * variables whose address is taken. Checks of the same atoms left in several
+ * branches are made once, at the nearest common dominator of the branches,
+ * when every path from there meets one of them past assignments only. *)
+let check_elim : bool ref = ref true;;
+
+type check_fact = {
+  cf_bound: Int64.t option;     (* n for an atom e >= n *)
+  cf_vars: int list;            (* The vids the atom reads *)
+  cf_mem: bool;                 (* Whether a store or call can change it *)
+}
+
+(* Atoms e >= n are kept apart from the other atoms of e. Keys ignore casts,
+ * so the type of the operand is part of the key: a signed bound says nothing
+ * of the same expression cast to unsigned. *)
+type atom_key =
+    AtomGe of ekey * typsig
+  | Atom of ekey * typsig
+
+module AtomMap = Map.Make(struct type t = atom_key let compare = compare end)
+
+class factReadsVisitor (vids: int list ref) (mem: bool ref) = object
+  inherit nopCilVisitor
+  method vvrbl (v: varinfo) =
+    vids := v.vid :: !vids;
+    if v.vglob || v.vaddrof then mem := true;
+    SkipChildren
+  method vlval (lv: lval) =
+    (match lv with (Mem _, _) -> mem := true | _ -> ());
+    DoChildren
+end
+
+(* The key of an atom. Atoms e >= n share the key of e, and e == 0 is !e. *)
+let atom_key (a: exp) : atom_key * Int64.t option =
+  let key (e: exp) = (key_of_exp e, typeSig (typeOf e)) in
+  let not_key (e: exp) = (KUnOp(LNot, key_of_exp e), typeSig (typeOf e)) in
+  match a with
+  | BinOp(Ge, e, Const(CInt64(n, _, _)), _) -> (AtomGe (key e), Some n)
+  | UnOp(LNot, e, _) -> (Atom (not_key e), None)
+  | BinOp(Eq, e, z, _) when isZero z -> (Atom (not_key e), None)
+  | _ -> (Atom (key a), None)
+
+let rec split_or (e: exp) : exp list =
+  match e with
+  | BinOp(LOr, e1, e2, _) -> List.append (split_or e1) (split_or e2)
+  | _ -> [e]
+
+let join_or (l: exp list) : exp =
+  List.fold_left (fun acc e -> BinOp(LOr, acc, e, intType)) (List.hd l) (List.tl l)
+
+(* Record that the atom a is false *)
+let add_fact (a: exp) (st: check_fact AtomMap.t) : check_fact AtomMap.t =
+  let (key, bound) = atom_key a in
+  let bound =
+    match bound with
+    | Some n ->
+        (try
+          match (AtomMap.find key st).cf_bound with
+          | Some m when compare m n < 0 -> Some m
+          | _ -> bound
+        with Not_found -> bound)
+    | None -> None
+  in
+  let vids = ref [] in
+  let mem = ref false in
+  ignore (visitCilExpr (new factReadsVisitor vids mem) a);
+  AtomMap.add key { cf_bound = bound; cf_vars = !vids; cf_mem = !mem } st
+
+let rec assume_true (e: exp) (st: check_fact AtomMap.t) : check_fact AtomMap.t =
+  match e with
+  | UnOp(LNot, e1, _) -> assume_false e1 st
+  | BinOp(LAnd, e1, e2, _) -> assume_true e2 (assume_true e1 st)
+  | BinOp(Lt, e1, (Const(CInt64 _) as c), t) -> add_fact (BinOp(Ge, e1, c, t)) st
+  | BinOp(Ge, e1, (Const(CInt64(n, _, _)) as c), t) when n = Int64.zero ->
+      add_fact (BinOp(Lt, e1, c, t)) st
+  | BinOp(Ne, e1, z, _) when isZero z -> add_fact (UnOp(LNot, e1, intType)) st
+  | _ -> add_fact (UnOp(LNot, e, intType)) st
+
+and assume_false (e: exp) (st: check_fact AtomMap.t) : check_fact AtomMap.t =
+  match e with
+  | BinOp(LOr, e1, e2, _) -> assume_false e2 (assume_false e1 st)
+  | UnOp(LNot, e1, _) -> assume_true e1 st
+  | _ -> add_fact e st
+
+let fact_implies (st: check_fact AtomMap.t) (a: exp) : bool =
+  let (key, bound) = atom_key a in
+  try
+    match bound, (AtomMap.find key st).cf_bound with
+    | Some n, Some m -> compare n m >= 0
+    | _ -> true
+  with Not_found -> false
+
+let forget (keep: check_fact -> bool) (st: check_fact AtomMap.t)
+    : check_fact AtomMap.t =
+  AtomMap.fold (fun k f acc -> if keep f then AtomMap.add k f acc else acc)
+    st AtomMap.empty
+
+let forget_var (vi: varinfo) (st: check_fact AtomMap.t) : check_fact AtomMap.t =
+  forget (fun f -> not (List.mem vi.vid f.cf_vars)) st
+
+let forget_mem (st: check_fact AtomMap.t) : check_fact AtomMap.t =
+  forget (fun f -> not f.cf_mem) st
+
+module CheckFlow = struct
+  let name = "carburizer checks"
+  let debug = ref false
+  type t = check_fact AtomMap.t
+  let copy (st: t) : t = st
+  let stmtStartData : t Inthash.t = Inthash.create 64
+  let pretty () (st: t) : doc =
+    dprintf "{%d atoms}" (AtomMap.fold (fun _ _ n -> n + 1) st 0)
+  let computeFirstPredecessor (s: stmt) (st: t) : t = st
+  (* The atoms known on both paths, with the weaker bound *)
+  let combinePredecessors (s: stmt) ~(old: t) (st: t) : t option =
+    let changed = ref false in
+    let meet =
+      AtomMap.fold
+        (fun k f acc ->
+          try
+            let g = AtomMap.find k st in
+            match f.cf_bound, g.cf_bound with
+            | Some m, Some n when compare n m > 0 ->
+                changed := true;
+                AtomMap.add k { f with cf_bound = Some n } acc
+            | _ -> AtomMap.add k f acc
+          with Not_found -> changed := true; acc)
+        old AtomMap.empty
+    in
+    if !changed then Some meet else None
+  let doInstr (i: instr) (st: t) : t Dataflow.action =
+    match i with
+    | Set((Var(vi), _), _, _) -> Dataflow.Done (forget_var vi st)
+    | Set((Mem _, _), _, _) -> Dataflow.Done (forget_mem st)
+    | Call(Some((Var(vi), _)), _, _, _) ->
+        Dataflow.Done (forget_var vi (forget_mem st))
+    | Call(_, _, _, _) -> Dataflow.Done (forget_mem st)
+    | Asm _ -> Dataflow.Done AtomMap.empty
+  let doStmt (s: stmt) (st: t) : t Dataflow.stmtaction = Dataflow.SDefault
+  let doGuard (e: exp) (st: t) : t Dataflow.guardaction =
+    Dataflow.GUse (assume_true e st)
+  let filterStmt (s: stmt) : bool = true
+end
+
+module CF = Dataflow.ForwardsDataFlow(CheckFlow)
+
+(* The variables a statement list writes, and whether it stores through a
+ * pointer or calls *)
+let loop_writes (stmts: stmt list) : int list * bool =
+  List.fold_left
+    (fun (vids, mem) s ->
+      match s.skind with
+      | Instr(il) ->
+          List.fold_left
+            (fun (vids, mem) i ->
+              match i with
+              | Set((Var(vi), _), _, _) -> (vi.vid :: vids, mem)
+              | Call(Some((Var(vi), _)), _, _, _) -> (vi.vid :: vids, true)
+              | _ -> (vids, true))
+            (vids, mem) il
+      | _ -> (vids, mem))
+    ([], false) stmts
+
+(* The vids a check reads, and whether it reads memory *)
+let check_reads (s: stmt) : int list * bool =
+  let vids = ref [] in
+  let mem = ref false in
+  (match s.skind with
+  | If(cond, _, _, _) -> ignore (visitCilExpr (new factReadsVisitor vids mem) cond)
+  | _ -> ());
+  (!vids, !mem)
+
+(* Whether s goes on to another statement without changing what a check
+ * reading vids (and memory if mem) sees, and without effects of its own that
+ * must run before the check returns. Only assignments to other locals are;
+ * a check never skips a call (an unlock, a register write), an asm or a
+ * store. *)
+let check_survives ((vids, mem): int list * bool) (s: stmt) : bool =
+  match s.skind with
+  | Instr(il) ->
+      List.for_all
+        (fun i ->
+          match i with
+          | Set((Var(vi), _), _, _) ->
+              not vi.vglob && not (List.mem vi.vid vids)
+              && not (mem && vi.vaddrof)
+          | Set((Mem _, _), _, _) | Call(_, _, _, _) | Asm _ -> false)
+        il
+  | Return(_, _) -> false
+  | _ -> true
+
+(* Whether a check can be moved above s. A labeled statement is a jump
+ * target, and code jumping there would miss the check. *)
+let check_can_pass (reads: int list * bool) (s: stmt) : bool =
+  s.labels = []
+  && (match s.skind with
+      | Instr(_) -> check_survives reads s
+      | _ -> false)
+
+class raiseChecksVisitor (checks: stmt list) = object
+  inherit nopCilVisitor
+  method vblock (b: block) =
+    if List.exists (fun s -> List.memq s checks) b.bstmts then begin
+      (* The statements so far are in reverse, the closest first *)
+      let rec raise_over (c: stmt) (reads: int list * bool) (acc: stmt list) =
+        match acc with
+        | s :: rest when check_can_pass reads s -> s :: raise_over c reads rest
+        | _ -> c :: acc
+      in
+      b.bstmts <-
+        List.rev
+          (List.fold_left
+             (fun acc s ->
+               if s.labels = [] && List.memq s checks then
+                 raise_over s (check_reads s) acc
+               else s :: acc)
+             [] b.bstmts)
+    end;
+    DoChildren
+end
+
+class removeStmtVisitor (gone: stmt) = object
+  inherit nopCilVisitor
+  method vblock (b: block) =
+    if List.memq gone b.bstmts then begin
+      b.bstmts <- List.filter (fun s -> s != gone) b.bstmts;
+      SkipChildren
+    end else DoChildren
+end
+
+(* The nearest statement that dominates both a and b *)
+let common_dominator (idoms: stmt option Inthash.t) (a: stmt) (b: stmt)
+    : stmt option =
+  let rec chain (s: stmt) : stmt list =
+    match Dominators.getIdom idoms s with
+    | Some d -> s :: chain d
+    | None -> [s]
+  in
+  let above_a = chain a in
+  try Some (List.find (fun s -> List.memq s above_a) (chain b))
+  with Not_found -> None
+
+(* Make the checks with the same atoms once, in front of their nearest common
+ * dominator d, when every path from d reaches one of them past statements
+ * check_survives lets it skip. A check without labels is moved there, so
+ * the others become redundant. Returns whether any check moved. The CFG of f
+ * must be computed. *)
+let merge_checks_at_dominators (f: fundec) (checks: stmt list) : bool =
+  let idoms = Dominators.computeIDom ~doCFG:false f in
+  let atoms_of (c: stmt) =
+    match c.skind with
+    | If(cond, _, _, _) ->
+        Some (List.sort compare (List.map (fun a -> fst (atom_key a)) (split_or cond)))
+    | _ -> None
+  in
+  let groups = ref [] in
+  List.iter
+    (fun c ->
+      match atoms_of c with
+      | Some atoms ->
+          (try
+            let group = List.assoc atoms !groups in
+            group := c :: !group
+          with Not_found -> groups := (atoms, ref [c]) :: !groups)
+      | None -> ())
+    checks;
+  let moved = ref false in
+  List.iter
+    (fun (_, group) ->
+      let group = List.rev !group in
+      match group with
+      | first :: (_ :: _ as rest) ->
+          let reads = check_reads first in
+          let d =
+            List.fold_left
+              (fun d c ->
+                match d with
+                | Some d -> common_dominator idoms d c
+                | None -> None)
+              (Some first) rest
+          in
+          (* Whether every path from s meets a check of the group first *)
+          let seen = Inthash.create 17 in
+          let rec reaches_check (s: stmt) : bool =
+            if List.memq s group then true
+            else if Inthash.mem seen s.sid then Inthash.find seen s.sid
+            else begin
+              (* A path back to s never meets a check *)
+              Inthash.add seen s.sid false;
+              let res =
+                s.succs <> [] && check_survives reads s
+                && List.for_all reaches_check s.succs in
+              Inthash.replace seen s.sid res;
+              res
+            end
+          in
+          (match d with
+          | Some d when not (List.memq d group) && reaches_check d ->
+              (try
+                let c = List.find (fun c -> c.labels = []) group in
+                ignore (visitCilBlock (new removeStmtVisitor c) f.sbody);
+                d.skind <- Block (mkBlock [c; mkStmt d.skind]);
+                moved := true
+              with Not_found -> ())
+          | _ -> ())
+      | _ -> ())
+    (List.rev !groups);
+  !moved
+
+(* The statements of l on a path from its header to s, both excluded *)
+let loop_path_to (l: nat_loop) (s: stmt) : stmt list =
+  let seen = Hashtbl.create 31 in
+  let rec back (work: stmt list) (acc: stmt list) : stmt list =
+    match work with
+    | [] -> acc
+    | t :: rest ->
+        if Hashtbl.mem seen t.sid || t == l.nl_header
+           || not (Hashtbl.mem l.nl_ids t.sid) then back rest acc
+        else begin
+          Hashtbl.replace seen t.sid ();
+          back (List.rev_append t.preds rest) (t :: acc)
         end
+  in
+  Hashtbl.replace seen s.sid ();
+  back s.preds []
+
+(* Move the checks of f up, drop their atoms that are known to be false,
+ * make the checks of several branches once at their common dominator, then
+ * move the checks that run on every entry of a loop, before any exit,
+ * read nothing the loop writes and only follow assignments in it
+ * (check_survives), in front of the outermost such loop.
+ * Returns the checks dropped and the number hoisted. f is modified in
+ * place. *)
+let elim_redundant_checks (f: fundec) (checks: stmt list) : stmt list * int =
+  ignore (visitCilBlock (new raiseChecksVisitor checks) f.sbody);
+  let dropped = ref [] in
+  (* The checks that some of their atoms are still needed in *)
+  let drop_implied (checks: stmt list) : stmt list =
+    Cil.computeCFGInfo f false;
+    Inthash.clear CheckFlow.stmtStartData;
+    (match f.sbody.bstmts with
+    | [] -> ()
+    | first :: _ ->
+        Inthash.add CheckFlow.stmtStartData first.sid AtomMap.empty;
+        CF.compute [first]);
+    List.filter
+      (fun s ->
+        match s.skind, Inthash.tryfind CheckFlow.stmtStartData s.sid with
+        | If(cond, b1, b2, l), Some st ->
+            let atoms = split_or cond in
+            let needed = List.filter (fun a -> not (fact_implies st a)) atoms in
+            if needed = [] then begin
+              s.skind <- Instr [];
+              dropped := s :: !dropped;
+              false
+            end else begin
+              if List.length needed < List.length atoms then
+                s.skind <- If(join_or needed, b1, b2, l);
+              true
+            end
+        | _ -> false)
+      checks
+  in
+  let kept = drop_implied checks in
+  let kept =
+    if merge_checks_at_dominators f kept then drop_implied kept else kept in
+  let hoisted = ref 0 in
+  if kept <> [] then begin
+    let idoms = Dominators.computeIDom ~doCFG:false f in
+    let loops =
+      Inthash.fold
+        (fun _ l acc ->
+          match l.nl_header.skind with
+          | Loop _ -> (l, loop_writes l.nl_stmts) :: acc
+          | _ -> acc)
+        (natural_loops f) []
+    in
+    (* Outermost first *)
+    let loops =
+      List.sort
+        (fun (a, _) (b, _) ->
+          compare (List.length b.nl_stmts) (List.length a.nl_stmts))
+        loops
+    in
+    List.iter
+      (fun s ->
+        let (vids, mem) = check_reads s in
+        let hoistable (l, (written, mem_written)) =
+          Hashtbl.mem l.nl_ids s.sid
+          && not (mem && mem_written)
+          && not (List.exists (fun v -> List.mem v written) vids)
+          && List.for_all (check_survives (vids, mem)) (loop_path_to l s)
+          && List.for_all
+               (fun st ->
+                 List.for_all (fun t -> Hashtbl.mem l.nl_ids t.sid) st.succs
+                 || Dominators.dominates idoms s st)
+               l.nl_stmts
+        in
+        try
+          let (l, _) = List.find hoistable loops in
+          let h = l.nl_header in
+          h.skind <- Block (mkBlock [mkStmt s.skind; mkStmt h.skind]);
+          s.skind <- Instr [];
+          incr hoisted
+        with Not_found -> ())
+      kept
+  end;
+  (!dropped, !hoisted)
+
+(*********** Redundant device reads ***********)
+
+(* Every register read (Devsigs.is_mmio_read) is an uncached bus round trip.
+ * A forward must-analysis finds the reads of a register already read on
+ * every path to them, with no register write, barrier or wait in between.
+ * Other calls may touch the device, so they forget every read too. The
+ * reads are keyed by the read function and the keys of its arguments; writes
+ * to a variable forget the reads whose address uses it, stores through
+ * pointers those whose address reads memory. The header of a natural loop
+ * forgets everything, whether the loop is a while or made of gotos: reading a
+ * register again in the next iteration is polling. The findings give the
+ * estimated cost of each redundant read (mmio_cost_ns). *)
+
+type mmio_read = {
+  mr_line: int;                 (* The line of the first read *)
+  mr_vars: int list;            (* The vids its address reads *)
+  mr_mem: bool;                 (* Whether a store can change its address *)
+}
+
+module ReadMap = Map.Make(struct type t = string * ekey list let compare = compare end)
+
+(* The key of a register read, or None if i is not one *)
+let mmio_read_key (i: instr) : (string * ekey list) option =
+  match i with
+  | Call(_, Lval(Var(fv), NoOffset), args, _) when Devsigs.is_mmio_read fv.vname ->
+      Some (fv.vname, List.map key_of_exp args)
+  | _ -> None
+
+(* The read as in the findings. Only printed for the reads reported. *)
+let mmio_read_text (i: instr) : string =
+  match i with
+  | Call(_, fn, args, _) ->
+      exp_to_string fn ^ "(" ^ String.concat ", " (List.map exp_to_string args) ^ ")"
+  | _ -> instr_to_string i
+
+(* The headers of the natural loops of the function being analyzed *)
+let mmio_loop_heads : unit Inthash.t = Inthash.create 13
+
+let forget_reads (keep: mmio_read -> bool) (st: mmio_read ReadMap.t)
+    : mmio_read ReadMap.t =
+  ReadMap.fold (fun k r acc -> if keep r then ReadMap.add k r acc else acc)
+    st ReadMap.empty
+
+let forget_lval_reads (lv: lval) (st: mmio_read ReadMap.t) : mmio_read ReadMap.t =
+  match lv with
+  | (Var(vi), _) -> forget_reads (fun r -> not (List.mem vi.vid r.mr_vars)) st
+  | (Mem _, _) -> forget_reads (fun r -> not r.mr_mem) st
+
+let mmio_transfer (i: instr) (st: mmio_read ReadMap.t) : mmio_read ReadMap.t =
+  match i with
+  | Set(lv, _, _) -> forget_lval_reads lv st
+  | Call(lvo, Lval(Var(fv), NoOffset), args, loc) ->
+      let st =
+        match mmio_read_key i with
+        | Some k ->
+            if ReadMap.mem k st then st
+            else begin
+              let vids = ref [] in
+              let mem = ref false in
+              List.iter
+                (fun e -> ignore (visitCilExpr (new factReadsVisitor vids mem) e))
+                args;
+              ReadMap.add k { mr_line = loc.line; mr_vars = !vids; mr_mem = !mem } st
+            end
+        | None ->
+            if Devsigs.is_report fv.vname then st else ReadMap.empty
+      in
+      (match lvo with Some lv -> forget_lval_reads lv st | None -> st)
+  | Call(_, _, _, _) | Asm _ -> ReadMap.empty
+
+module MmioFlow = struct
+  let name = "carburizer mmio reads"
+  let debug = ref false
+  type t = mmio_read ReadMap.t
+  let copy (st: t) : t = st
+  let stmtStartData : t Inthash.t = Inthash.create 64
+  let pretty () (st: t) : doc =
+    dprintf "{%a}" (d_list ", " (fun () (name, _) -> text name))
+      (ReadMap.fold (fun k _ l -> k :: l) st [])
+  let computeFirstPredecessor (s: stmt) (st: t) : t = st
+  (* The reads done on both paths *)
+  let combinePredecessors (s: stmt) ~(old: t) (st: t) : t option =
+    let changed = ref false in
+    let meet =
+      ReadMap.fold
+        (fun k r acc ->
+          if ReadMap.mem k st then ReadMap.add k r acc
+          else begin changed := true; acc end)
+        old ReadMap.empty
+    in
+    if !changed then Some meet else None
+  let doInstr (i: instr) (st: t) : t Dataflow.action =
+    Dataflow.Done (mmio_transfer i st)
+  let doStmt (s: stmt) (st: t) : t Dataflow.stmtaction =
+    if Inthash.mem mmio_loop_heads s.sid then Dataflow.SUse ReadMap.empty
+    else Dataflow.SDefault
+  let doGuard (e: exp) (st: t) : t Dataflow.guardaction = Dataflow.GDefault
+  let filterStmt (s: stmt) : bool = true
+end
 
-        | Set(lvalue_location,e, loc) ->
-        begin
-            lvalue_list := self#find_lvals_instr i;
-            for i = 0 to (List.length !lvalue_list) - 1 do
-                let lvalue = (List.nth !lvalue_list i) in
-                let (host, offset) = lvalue in
-                (match host with
-                | Var  (vi) ->
-                        begin
-                             if (self#isbad_exp e  = 1) then
-                                     begin
-                                         Hashtbl.add dirrrty
-                                         (vi.vname,curr_func.svar.vname)
-                                         (exp_to_string e);
-                                         temp_bad_functions <-
-                                             vi.vname::temp_bad_functions;
-					 Hashtbl.add when_dirrrty (vi.vname, curr_func.svar.vname) loc.line;
-                                     end;
-
-                              if (self#iscont_exp e  = 1) then      
-                                 begin
-                                    Hashtbl.add contaminated
-                                    (vi.vname,curr_func.svar.vname)
-                                   (exp_to_string e);
-                                  temp_cont_functions
-                                  <-vi.vname::temp_cont_functions;
-                                 end; 
-                        end
-		
-		 
-                | _ -> ();
-                )
-            done;
-            
+module MF = Dataflow.ForwardsDataFlow(MmioFlow)
+
+(* The redundant reads of f: their line, the read and the line of the first
+ * read. The CFG of f must be computed and loops be its natural loops. *)
+let redundant_mmio_reads (f: fundec) (loops: nat_loop Inthash.t)
+    : (int * string * int) list =
+  Inthash.clear MmioFlow.stmtStartData;
+  Inthash.clear mmio_loop_heads;
+  Inthash.iter (fun sid _ -> Inthash.replace mmio_loop_heads sid ()) loops;
+  match f.sbody.bstmts with
+  | [] -> []
+  | first :: _ ->
+      Inthash.add MmioFlow.stmtStartData first.sid ReadMap.empty;
+      MF.compute [first];
+      List.rev (List.fold_left
+        (fun acc s ->
+          match s.skind, Inthash.tryfind MmioFlow.stmtStartData s.sid with
+          | Instr(il), Some st ->
+              snd (List.fold_left
+                (fun (st, acc) i ->
+                  let acc =
+                    match mmio_read_key i with
+                    | Some k when ReadMap.mem k st ->
+                        ((get_instrLoc i).line, mmio_read_text i,
+                         (ReadMap.find k st).mr_line) :: acc
+                    | _ -> acc
+                  in
+                  (mmio_transfer i st, acc))
+                (st, acc) il)
+          | _ -> acc)
+        [] f.sallstmts)
+
+(*********** Interrupt handler profiles ***********)
+
+(* The handlers registered with request_irq and its variants run in hard
+ * interrupt context, so everything they do adds to the interrupt latency.
+ * Each handler gets a static profile over the functions of the file it may
+ * call directly (calls through pointers are not followed): its register
+ * reads and writes, busy delays, loops that read registers and allocations,
+ * each counted once per call site. The estimated latency counts
+ * mmio_cost_ns per read and the delays with a constant argument; writes are
+ * posted and not counted. The thread function of a threaded interrupt runs
+ * in a kernel thread and is not profiled. *)
+
+(* The registration calls and the argument position of the hard handler *)
+let irq_registrations : (string * int) list =
+  [ (iNTR_STRING, 1); ("request_threaded_irq", 1);
+    ("request_any_context_irq", 1);
+    ("devm_request_irq", 2); ("devm_request_threaded_irq", 2) ];;
+
+(* The busy delays and their unit in ns *)
+let delay_units : (string * int) list =
+  [ ("ndelay", 1); ("udelay", 1000); ("mdelay", 1000000) ];;
+
+type isr_profile = {
+  ip_handler: fundec;
+  ip_funcs: int;                (* The functions reachable from the handler *)
+  ip_reads: int;
+  ip_writes: int;
+  ip_delays: int;
+  ip_delay_ns: int;             (* Of the delays with a constant argument *)
+  ip_read_loops: int;
+  ip_allocs: int;
+}
+
+(* The profiles of the handlers of the file, highest latency first *)
+let isr_profiles : isr_profile list ref = ref [];;
+
+let isr_latency_ns (p: isr_profile) : int =
+  p.ip_reads * !mmio_cost_ns + p.ip_delay_ns
+
+let isr_summary (p: isr_profile) : string =
+  Printf.sprintf
+    "~%d us: %d reads, %d writes, %d delays, %d register loops, %d allocations in %d functions"
+    (isr_latency_ns p / 1000) p.ip_reads p.ip_writes p.ip_delays
+    p.ip_read_loops p.ip_allocs p.ip_funcs
+
+(* The function an argument names, through casts *)
+let rec fun_of_exp (e: exp) : varinfo option =
+  match e with
+  | AddrOf(Var(vi), NoOffset) | Lval(Var(vi), NoOffset)
+    when isFunctionType vi.vtype -> Some vi
+  | CastE(_, e1) -> fun_of_exp e1
+  | _ -> None
+
+let stmt_reads_registers (s: stmt) : bool =
+  match s.skind with
+  | Instr(il) ->
+      List.exists
+        (fun i ->
+          match i with
+          | Call(_, Lval(Var(fv), NoOffset), _, _) -> Devsigs.is_mmio_read fv.vname
+          | _ -> false)
+        il
+  | _ -> false
+
+let profile_handler (cg: CG.callgraph) (defined: (int, fundec) Hashtbl.t)
+    (handler: fundec) : isr_profile =
+  let funcs = ref 0 in
+  let reads = ref 0 in
+  let writes = ref 0 in
+  let delays = ref 0 in
+  let delay_ns = ref 0 in
+  let read_loops = ref 0 in
+  let allocs = ref 0 in
+  let count_call (name: string) (args: exp list) : unit =
+    if Devsigs.is_mmio_read name then incr reads
+    else if Devsigs.is_mmio_write name then incr writes
+    else if Devsigs.is_alloc name then incr allocs
+    else if List.mem_assoc name delay_units then begin
+      incr delays;
+      match args with
+      | [arg] ->
+          (match isInteger (constFold true arg) with
+          | Some n ->
+              delay_ns := !delay_ns + Int64.to_int n * List.assoc name delay_units
+          | None -> ())
+      | _ -> ()
+    end
+  in
+  let seen = Hashtbl.create 17 in
+  let rec visit (fd: fundec) : unit =
+    if not (Hashtbl.mem seen fd.svar.vid) then begin
+      Hashtbl.add seen fd.svar.vid ();
+      Hashtbl.replace isr_context fd.svar.vid ();
+      incr funcs;
+      ensure_cfg fd;
+      List.iter
+        (fun s ->
+          match s.skind with
+          | Instr(il) ->
+              List.iter
+                (fun i ->
+                  match i with
+                  | Call(_, Lval(Var(fv), NoOffset), args, _) ->
+                      count_call fv.vname args
+                  | _ -> ())
+                il
+          | _ -> ())
+        fd.sallstmts;
+      Inthash.iter
+        (fun _ l -> if List.exists stmt_reads_registers l.nl_stmts then incr read_loops)
+        (natural_loops fd);
+      try
+        let n = Hashtbl.find cg fd.svar.vname in
+        Inthash.iter
+          (fun _ (m: CG.callnode) ->
+            match m.CG.cnInfo with
+            | CG.NIVar(vi, _) ->
+                (try visit (Hashtbl.find defined vi.vid) with Not_found -> ())
+            | CG.NIIndirect(_, _) -> ())
+          n.CG.cnCallees
+      with Not_found -> ()
+    end
+  in
+  visit handler;
+  { ip_handler = handler; ip_funcs = !funcs; ip_reads = !reads;
+    ip_writes = !writes; ip_delays = !delays; ip_delay_ns = !delay_ns;
+    ip_read_loops = !read_loops; ip_allocs = !allocs }
+
+(* The functions passed to the given registration calls in f, in order,
+ * each once *)
+let registered_callbacks (f: file) (regs: (string * int) list) : varinfo list =
+  let found = ref [] in
+  iterGlobals f
+    (fun g ->
+      match g with
+      | GFun(fd, _) ->
+          ensure_cfg fd;
+          List.iter
+            (fun s ->
+              match s.skind with
+              | Instr(il) ->
+                  List.iter
+                    (fun i ->
+                      match i with
+                      | Call(_, Lval(Var(fv), NoOffset), args, _)
+                        when List.mem_assoc fv.vname regs ->
+                          let pos = List.assoc fv.vname regs in
+                          if List.length args > pos then
+                            (match fun_of_exp (List.nth args pos) with
+                            | Some vi when not (List.memq vi !found) ->
+                                found := vi :: !found
+                            | _ -> ())
+                      | _ -> ())
+                    il
+              | _ -> ())
+            fd.sallstmts
+      | _ -> ());
+  List.rev !found
+
+(* Find the handlers registered in f, record their names in
+ * def_interrupt_fns, and profile those defined in f. Each profile is also
+ * an isr_profile finding at the handler. *)
+let profile_isrs (f: file) : unit =
+  let defined = Hashtbl.create 63 in
+  iterGlobals f
+    (fun g ->
+      match g with
+      | GFun(fd, _) -> Hashtbl.replace defined fd.svar.vid fd
+      | _ -> ());
+  let handlers = ref [] in
+  List.iter
+    (fun vi ->
+      if not (List.mem vi.vname !def_interrupt_fns) then
+        def_interrupt_fns := vi.vname :: !def_interrupt_fns;
+      try handlers := Hashtbl.find defined vi.vid :: !handlers
+      with Not_found -> ())
+    (registered_callbacks f irq_registrations);
+  if !handlers <> [] then begin
+    let cg = CG.computeGraph f in
+    let profiles = List.map (profile_handler cg defined) (List.rev !handlers) in
+    isr_profiles :=
+      List.stable_sort
+        (fun a b -> compare (isr_latency_ns b) (isr_latency_ns a)) profiles;
+    List.iter
+      (fun p ->
+        add_finding { fi_category = "isr_profile";
+                      fi_file = p.ip_handler.svar.vdecl.file;
+                      fi_function = p.ip_handler.svar.vname;
+                      fi_line = p.ip_handler.svar.vdecl.line;
+                      fi_source = isr_summary p;
+                      fi_fix = "none";
+                      fi_cost_us = isr_latency_ns p / 1000;
+                    })
+      profiles
+  end
+
+(*********** Busy waits ***********)
+
+(* A polling loop that calls udelay, ndelay or mdelay keeps the CPU busy for
+ * the whole wait. The delays of one iteration (the longest branch of each
+ * conditional, an inner loop counted once) times the bound of the loop give
+ * the worst-case busy time: tickval_exp iterations or the time budget for a
+ * loop Carburizer guards, the bound of its own counter otherwise. Outside
+ * interrupt context, a delay of sleep_threshold_ns or more per iteration
+ * could be a sleeping wait (usleep_range, msleep). Delays with a
+ * non-constant argument are not counted. *)
+let sleep_threshold_ns : int = 10000;;
+
+type busy_bound =
+  | BoundIters of int           (* Iterations *)
+  | BoundBudget of int          (* Milliseconds *)
+
+(* The busy delay of one iteration in ns, and the delay calls counted *)
+let rec busy_delay (sl: stmt list) : int * string list =
+  List.fold_left
+    (fun (ns, sites) s ->
+      let (ns', sites') = stmt_busy_delay s in
+      (ns + ns', List.append sites sites'))
+    (0, []) sl
+
+and stmt_busy_delay (s: stmt) : int * string list =
+  match s.skind with
+  | Instr(il) ->
+      List.fold_left
+        (fun (ns, sites) i ->
+          match i with
+          | Call(_, Lval(Var(fv), NoOffset), [arg], _)
+            when List.mem_assoc fv.vname delay_units ->
+              (match isInteger (constFold true arg) with
+              | Some n ->
+                  (ns + Int64.to_int n * List.assoc fv.vname delay_units,
+                   List.append sites [Printf.sprintf "%s(%Ld)" fv.vname n])
+              | None -> (ns, sites))
+          | _ -> (ns, sites))
+        (0, []) il
+  | If(_, b1, b2, _) ->
+      let (n1, s1) = busy_delay b1.bstmts in
+      let (n2, s2) = busy_delay b2.bstmts in
+      if n1 >= n2 then (n1, s1) else (n2, s2)
+  | Loop(b1, _, _, _) | Block(b1) | Switch(_, b1, _, _) -> busy_delay b1.bstmts
+  | _ -> (0, [])
+
+(* The bound of a loop with its own counter: the largest constant a counter
+ * is compared with on exit or, for a count down to zero, set to in f *)
+let counter_bound (f: fundec) (exits: exp list) (counters: string list)
+    : int option =
+  let best = ref 0 in
+  let rec strip (e: exp) : exp =
+    match e with
+    | CastE(_, e1) | UnOp(LNot, e1, _) -> strip e1
+    | _ -> e
+  in
+  let is_counter (e: exp) : bool =
+    match strip e with
+    | Lval(Var(vi), NoOffset) -> List.mem vi.vname counters
+    | _ -> false
+  in
+  let const (e: exp) : int =
+    match isInteger (constFold true e) with
+    | Some n -> Int64.to_int n
+    | None -> 0
+  in
+  List.iter
+    (fun e ->
+      match strip e with
+      | BinOp((Lt | Le | Gt | Ge | Eq | Ne), e1, e2, _) ->
+          if is_counter e1 then best := max !best (const e2)
+          else if is_counter e2 then best := max !best (const e1)
+      | _ -> ())
+    exits;
+  if !best <= 1 then
+    List.iter
+      (fun s ->
+        match s.skind with
+        | Instr(il) ->
+            List.iter
+              (fun i ->
+                match i with
+                | Set((Var(vi), NoOffset), e, _) when List.mem vi.vname counters ->
+                    best := max !best (const e)
+                | _ -> ())
+              il
+        | _ -> ())
+      f.sallstmts;
+  if !best > 1 then Some !best else None
+
+(*********** Datapath allocations ***********)
+
+(* The datapath of a driver runs for every interrupt or packet, where an
+ * allocation or a DMA mapping is better done ahead of time from a
+ * preallocated ring. Its roots are the interrupt handlers
+ * (def_interrupt_fns), the NAPI poll callbacks and the ndo_start_xmit of the
+ * net_device_ops initializers. The functions of the file they may call
+ * directly are reached breadth-first, and every allocation (Devsigs.is_alloc),
+ * call with GFP_ATOMIC and DMA mapping in them is reported with the shortest
+ * call path from a root. The gfp flags of a call are its gfp_t argument, or
+ * the argument at Devsigs.gfp_arg_position of the callee. They are taken
+ * for GFP_ATOMIC when they have a flag of Devsigs.gfp_atomic_mask
+ * (__GFP_HIGH), and for GFP_NOWAIT when they have none of
+ * Devsigs.gfp_wait_mask (__GFP_WAIT). *)
+let napi_registrations : (string * int) list =
+  [ ("netif_napi_add", 2); ("netif_napi_add_weight", 2);
+    ("netif_tx_napi_add", 2); ("netif_napi_add_tx", 2) ];;
+
+let datapath_ops : (string * string list) list =
+  [ ("net_device_ops", ["ndo_start_xmit"]) ];;
+
+let dma_map_fns : string list =
+  [ "dma_map_single"; "dma_map_page"; "dma_map_sg"; "skb_frag_dma_map";
+    "pci_map_single"; "pci_map_page"; "pci_map_sg" ];;
+
+let datapath_allocs : int ref = ref 0;;
+let datapath_maps : int ref = ref 0;;
+
+(* The gfp flags argument of a call, if the callee has one *)
+let gfp_arg (fv: varinfo) (args: exp list) : exp option =
+  let rec find formals args =
+    match formals, args with
+    | (_, TNamed(ti, _), _) :: _, a :: _ when ti.tname = "gfp_t" -> Some a
+    | _ :: formals', _ :: args' -> find formals' args'
+    | _ -> None
+  in
+  let by_type =
+    match fv.vtype with
+    | TFun(_, Some formals, _, _) -> find formals args
+    | _ -> None
+  in
+  match by_type, Devsigs.gfp_arg_position fv.vname with
+  | Some a, _ -> Some a
+  | None, Some pos when pos <= List.length args -> Some (List.nth args (pos - 1))
+  | _ -> None
+
+(* GFP_ATOMIC or GFP_NOWAIT, if the gfp flags of a call are one of them *)
+let gfp_atomic (fv: varinfo) (args: exp list) : string option =
+  match gfp_arg fv args with
+  | Some e ->
+      (match isInteger (constFold true e) with
+      | Some n when Int64.logand n !Devsigs.gfp_atomic_mask <> Int64.zero ->
+          Some "GFP_ATOMIC"
+      | Some n when Int64.logand n !Devsigs.gfp_wait_mask = Int64.zero ->
+          Some "GFP_NOWAIT"
+      | _ -> None)
+  | None -> None
+
+(* The ops functions of the datapath_ops initializers of f *)
+let datapath_op_roots (f: file) : varinfo list =
+  let found = ref [] in
+  iterGlobals f
+    (fun g ->
+      match g with
+      | GVar(_, { init = Some (CompoundInit(t, inits)) }, _) ->
+          (match unrollType t with
+          | TComp(ci, _) when List.mem_assoc ci.cname datapath_ops ->
+              let fields = List.assoc ci.cname datapath_ops in
+              List.iter
+                (fun (off, i) ->
+                  match off, i with
+                  | Field(fi, NoOffset), SingleInit(e)
+                    when List.mem fi.fname fields ->
+                      (match fun_of_exp e with
+                      | Some vi when not (List.memq vi !found) ->
+                          found := vi :: !found
+                      | _ -> ())
+                  | _ -> ())
+                inits
+          | _ -> ())
+      | _ -> ());
+  List.rev !found
+
+(* Report the allocations and DMA mappings reachable from the datapath
+ * roots of f *)
+let check_datapath (f: file) : unit =
+  let defined = Hashtbl.create 63 in
+  let by_name = Hashtbl.create 63 in
+  iterGlobals f
+    (fun g ->
+      match g with
+      | GFun(fd, _) ->
+          Hashtbl.replace defined fd.svar.vid fd;
+          Hashtbl.replace by_name fd.svar.vname fd
+      | _ -> ());
+  let roots =
+    List.concat
+      [ List.map (fun name -> ("irq", name)) (List.rev !def_interrupt_fns);
+        List.map (fun vi -> ("napi", vi.vname))
+          (registered_callbacks f napi_registrations);
+        List.map (fun vi -> ("xmit", vi.vname)) (datapath_op_roots f) ]
+  in
+  (* The call path of each function reached, root first *)
+  let paths : (int, string list) Hashtbl.t = Hashtbl.create 31 in
+  let work = Queue.create () in
+  List.iter
+    (fun (kind, name) ->
+      try
+        let fd = Hashtbl.find by_name name in
+        if not (Hashtbl.mem paths fd.svar.vid) then begin
+          Hashtbl.add paths fd.svar.vid [kind ^ " " ^ name];
+          Queue.add fd work
         end
+      with Not_found -> ())
+    roots;
+  let cg = lazy (CG.computeGraph f) in
+  let report (fd: fundec) (category: string) (loc: location) (what: string) =
+    add_finding { fi_category = category;
+                  fi_file = loc.file;
+                  fi_function = fd.svar.vname;
+                  fi_line = loc.line;
+                  fi_source = what ^ " via "
+                    ^ String.concat " -> " (Hashtbl.find paths fd.svar.vid);
+                  fi_fix = "none";
+                  fi_cost_us = 0;
+                }
+  in
+  while not (Queue.is_empty work) do
+    let fd = Queue.take work in
+    let path = Hashtbl.find paths fd.svar.vid in
+    ensure_cfg fd;
+    List.iter
+      (fun s ->
+        match s.skind with
+        | Instr(il) ->
+            List.iter
+              (fun i ->
+                match i with
+                | Call(_, Lval(Var(fv), NoOffset), args, loc) ->
+                    let atomic = gfp_atomic fv args in
+                    if Devsigs.is_alloc fv.vname || atomic <> None then begin
+                      incr datapath_allocs;
+                      report fd "datapath_alloc" loc
+                        (match atomic with
+                        | Some flags -> fv.vname ^ "(" ^ flags ^ ")"
+                        | None -> fv.vname)
+                    end else if List.mem fv.vname dma_map_fns then begin
+                      incr datapath_maps;
+                      report fd "datapath_dma_map" loc fv.vname
+                    end
+                | _ -> ())
+              il
+        | _ -> ())
+      fd.sallstmts;
+    (try
+      let n = Hashtbl.find (Lazy.force cg) fd.svar.vname in
+      Inthash.iter
+        (fun _ (m: CG.callnode) ->
+          match m.CG.cnInfo with
+          | CG.NIVar(vi, _) ->
+              (try
+                let callee = Hashtbl.find defined vi.vid in
+                if not (Hashtbl.mem paths vi.vid) then begin
+                  Hashtbl.add paths vi.vid (List.append path [vi.vname]);
+                  Queue.add callee work
+                end
+              with Not_found -> ())
+          | CG.NIIndirect(_, _) -> ())
+        n.CG.cnCallees
+    with Not_found -> ())
+  done
+
+(*********** DMA buffer lifecycle ***********)
+
+(* On hosts without coherent DMA, every sync flushes or invalidates the cache
+ * lines of the buffer and every streaming map and unmap programs the IOMMU.
+ * A forward must-analysis follows the DMA handles of each checked function
+ * from dma_map_single or dma_alloc_coherent through the syncs to the unmap,
+ * with the last of these done to the handle. A sync repeats the sync before
+ * it when both are in the same direction with no other operation on the
+ * handle in between; a sync for the device after a sync for the CPU is how
+ * the DMA API gives the buffer back, and is never reported. A sync after the
+ * unmap is reported too. Handles are keyed by key_of_exp: the result of a
+ * map, and otherwise the argument at the first Devsigs.dma_arg_positions of
+ * the call. Other calls may sync or unmap, so they forget every handle.
+ * Separately, a natural loop that maps and unmaps the same handle could use
+ * one persistent mapping and syncs. *)
+type dma_op = DmaMap | DmaAlloc | DmaSyncCpu | DmaSyncDevice | DmaUnmap
+
+let dma_ops : (string * dma_op) list =
+  [ ("dma_map_single", DmaMap); ("dma_map_page", DmaMap);
+    ("pci_map_single", DmaMap); ("pci_map_page", DmaMap);
+    ("dma_alloc_coherent", DmaAlloc); ("pci_alloc_consistent", DmaAlloc);
+    ("dma_sync_single_for_cpu", DmaSyncCpu);
+    ("pci_dma_sync_single_for_cpu", DmaSyncCpu);
+    ("dma_sync_single_for_device", DmaSyncDevice);
+    ("pci_dma_sync_single_for_device", DmaSyncDevice);
+    ("dma_unmap_single", DmaUnmap); ("dma_unmap_page", DmaUnmap);
+    ("pci_unmap_single", DmaUnmap); ("pci_unmap_page", DmaUnmap);
+    ("dma_free_coherent", DmaUnmap); ("pci_free_consistent", DmaUnmap);
+    ("dma_pool_alloc", DmaAlloc); ("dma_pool_free", DmaUnmap) ];;
+
+type dma_handle = {
+  dh_last: dma_op;              (* The last operation done to the handle *)
+  dh_line: int;                 (* Its line *)
+  dh_vars: int list;            (* The vids the handle reads *)
+  dh_mem: bool;                 (* Whether a store can change the handle *)
+}
+
+module KeyMap = Map.Make(struct type t = ekey let compare = compare end)
+
+let rec strip_casts (e: exp) : exp =
+  match e with
+  | CastE(_, e1) -> strip_casts e1
+  | _ -> e
+
+(* The operation of a call and its handle, as an lvalue *)
+let dma_call (i: instr) : (dma_op * lval) option =
+  match i with
+  | Call(lvo, Lval(Var(fv), NoOffset), args, _)
+    when List.mem_assoc fv.vname dma_ops ->
+      let op = List.assoc fv.vname dma_ops in
+      if op = DmaMap then
+        (match lvo with Some lv -> Some (op, lv) | None -> None)
+      else begin
+        match Devsigs.dma_arg_positions fv.vname with
+        | pos :: _ when pos >= 1 && pos <= List.length args ->
+            (match strip_casts (List.nth args (pos - 1)), op with
+            | AddrOf(lv), DmaAlloc -> Some (op, lv)
+            | e, DmaAlloc -> Some (op, mkMem ~addr:e ~off:NoOffset)
+            | Lval(lv), _ -> Some (op, lv)
+            | _ -> None)
+        | _ -> None
+      end
+  | _ -> None
+
+let dma_key (lv: lval) : ekey = key_of_exp (Lval lv)
+
+let forget_handles (keep: dma_handle -> bool) (st: dma_handle KeyMap.t)
+    : dma_handle KeyMap.t =
+  KeyMap.fold (fun k h acc -> if keep h then KeyMap.add k h acc else acc)
+    st KeyMap.empty
+
+let forget_lval_handles (lv: lval) (st: dma_handle KeyMap.t)
+    : dma_handle KeyMap.t =
+  match lv with
+  | (Var(vi), _) -> forget_handles (fun h -> not (List.mem vi.vid h.dh_vars)) st
+  | (Mem _, _) -> forget_handles (fun h -> not h.dh_mem) st
+
+let new_handle (op: dma_op) (lv: lval) (line: int) : dma_handle =
+  let vids = ref [] in
+  let mem = ref false in
+  ignore (visitCilLval (new factReadsVisitor vids mem) lv);
+  { dh_last = op; dh_line = line; dh_vars = !vids; dh_mem = !mem }
+
+(* Why the DMA call i is redundant in state st, if it is *)
+let redundant_dma_call (i: instr) (st: dma_handle KeyMap.t) : string option =
+  match dma_call i with
+  | Some ((DmaSyncCpu | DmaSyncDevice) as op, lv) ->
+      (try
+        let h = KeyMap.find (dma_key lv) st in
+        (match h.dh_last, op with
+        | DmaSyncCpu, DmaSyncCpu ->
+            Some (Printf.sprintf "%s already synced for the CPU at line %d"
+                    (lval_to_string lv) h.dh_line)
+        | DmaSyncDevice, DmaSyncDevice ->
+            Some (Printf.sprintf "%s already synced for the device at line %d"
+                    (lval_to_string lv) h.dh_line)
+        | DmaUnmap, _ ->
+            Some (Printf.sprintf "%s synced after its unmap at line %d"
+                    (lval_to_string lv) h.dh_line)
+        | _ -> None)
+      with Not_found -> None)
+  | _ -> None
+
+let dma_transfer (i: instr) (st: dma_handle KeyMap.t) : dma_handle KeyMap.t =
+  let line = (get_instrLoc i).line in
+  match dma_call i with
+  | Some (op, lv) ->
+      (* The result of the call and the handle an allocation fills are
+       * written *)
+      let st =
+        match i with
+        | Call(Some r, _, _, _) -> forget_lval_handles r st
+        | _ -> st
+      in
+      let st = if op = DmaAlloc then forget_lval_handles lv st else st in
+      KeyMap.add (dma_key lv) (new_handle op lv line) st
+  | None ->
+      (match i with
+      | Call(lvo, Lval(Var(fv), NoOffset), _, _)
+        when Devsigs.is_report fv.vname || Devsigs.is_mmio_read fv.vname
+             || Devsigs.is_mmio_write fv.vname || Devsigs.is_barrier fv.vname ->
+          (match lvo with Some lv -> forget_lval_handles lv st | None -> st)
+      | Call(_, _, _, _) | Asm _ -> KeyMap.empty
+      | Set(lv, _, _) -> forget_lval_handles lv st)
+
+module DmaFlow = struct
+  let name = "carburizer dma lifecycle"
+  let debug = ref false
+  type t = dma_handle KeyMap.t
+  let copy (st: t) : t = st
+  let stmtStartData : t Inthash.t = Inthash.create 64
+  let pretty () (st: t) : doc =
+    dprintf "{%d handles}" (KeyMap.fold (fun _ _ n -> n + 1) st 0)
+  let computeFirstPredecessor (s: stmt) (st: t) : t = st
+  (* The handles with the same last operation on both paths *)
+  let combinePredecessors (s: stmt) ~(old: t) (st: t) : t option =
+    let changed = ref false in
+    let meet =
+      KeyMap.fold
+        (fun k h acc ->
+          try
+            let h' = KeyMap.find k st in
+            if h'.dh_last <> h.dh_last then begin changed := true; acc end
+            else KeyMap.add k h acc
+          with Not_found -> changed := true; acc)
+        old KeyMap.empty
+    in
+    if !changed then Some meet else None
+  let doInstr (i: instr) (st: t) : t Dataflow.action =
+    Dataflow.Done (dma_transfer i st)
+  let doStmt (s: stmt) (st: t) : t Dataflow.stmtaction = Dataflow.SDefault
+  let doGuard (e: exp) (st: t) : t Dataflow.guardaction = Dataflow.GDefault
+  let filterStmt (s: stmt) : bool = true
+end
 
-     | _ -> (); 
-       
-   end
+module DF = Dataflow.ForwardsDataFlow(DmaFlow)
+
+(* The redundant syncs of f: their line and why. The CFG of f must be
+ * computed. *)
+let redundant_dma_syncs (f: fundec) : (int * string) list =
+  Inthash.clear DmaFlow.stmtStartData;
+  match f.sbody.bstmts with
+  | [] -> []
+  | first :: _ ->
+      Inthash.add DmaFlow.stmtStartData first.sid KeyMap.empty;
+      DF.compute [first];
+      List.rev (List.fold_left
+        (fun acc s ->
+          match s.skind, Inthash.tryfind DmaFlow.stmtStartData s.sid with
+          | Instr(il), Some st ->
+              snd (List.fold_left
+                (fun (st, acc) i ->
+                  let acc =
+                    match redundant_dma_call i st with
+                    | Some why -> ((get_instrLoc i).line, why) :: acc
+                    | None -> acc
+                  in
+                  (dma_transfer i st, acc))
+                (st, acc) il)
+          | _ -> acc)
+        [] f.sallstmts)
+
+(* The maps of the loops of f that also unmap the handle: their line and
+ * handle, each once *)
+let dma_maps_in_loops (loops: nat_loop Inthash.t) : (int * string) list =
+  let found = Hashtbl.create 7 in
+  Inthash.iter
+    (fun _ l ->
+      let maps = ref [] in
+      let unmaps = ref [] in
+      List.iter
+        (fun s ->
+          match s.skind with
+          | Instr(il) ->
+              List.iter
+                (fun i ->
+                  match dma_call i with
+                  | Some (DmaMap, lv) ->
+                      maps := ((get_instrLoc i).line, dma_key lv, lv) :: !maps
+                  | Some (DmaUnmap, lv) -> unmaps := dma_key lv :: !unmaps
+                  | _ -> ())
+                il
+          | _ -> ())
+        l.nl_stmts;
+      List.iter
+        (fun (line, k, lv) ->
+          if List.mem k !unmaps then
+            Hashtbl.replace found (line, k) (line, lval_to_string lv))
+        !maps)
+    loops;
+  List.sort compare (Hashtbl.fold (fun _ m l -> m :: l) found [])
+
+(* The initial visitor for preprocessing. Counts the calls to system halting
+ * functions in this pre-scan step. The taint tables are filled by
+ * compute_taint. *)
+class initialVisitor = object (self) 
+    inherit nopCilVisitor
 
-    (* Visits every "instruction" *)
-     method vinst (i: instr) : instr list visitAction =
-     begin
-        self#inst_process i;
-        DoChildren;
-     end
+ val mutable curr_func : fundec = emptyFunction "temp";
+ val mutable block_count = ref 0;
 
      (* Visits every "statement" *)
      method vstmt (s: stmt) : stmt visitAction =
      begin
         match s.skind with
 	
-        | Return(Some(e),_) ->
-          begin
-             if (self#isbad_exp e = 1) then
-	(               funcs_with_cont_return
-                         := (List.append
-                         !funcs_with_cont_return
-                         [curr_func.svar.vname]);
-	);
-                         DoChildren;
-          end
-          
        |  Instr(ilist) ->
             begin
                 let halting_found = ref 0 in
@@ -685,7 +2830,7 @@ class initialVisitor = object (self)
                   let cur_instr = (List.nth ilist j) in
                     match cur_instr with
                     | Call(lvalue_option,e,el,loc) -> 
-                          if (ishalting (exp_to_string e) = 1) then
+                          if (ishalting (call_name e) = 1) then
                               begin
                                   let shadow_call_fundec = (emptyFunction
                                   "shadow_ioctl_recover" ) in
@@ -724,11 +2869,7 @@ class initialVisitor = object (self)
      (* Visits every function *)
      method vfunc (f: fundec) : fundec visitAction =
      begin
-        (* Empty the temp bad list *)
-         temp_bad_functions <- []; 
         block_count := 0;
-        (* Empty the temp cont list *)
-        temp_cont_functions <- [];
         
         curr_func <- f; (*Store the value of current func before getting into
                         deeper visitor analysis. *)
@@ -753,21 +2894,35 @@ class driverVisitor = object (self) (* self is equivalent to this in Java/C++ *)
     val mutable per_fun : fundec list = [(emptyFunction "temp") ;]; 
     val mutable per_fun_ctr : stmt list = dummy_stmt_list;
     val mutable num_array_checks_added = 0;
+    val mutable added_checks : stmt list = []; (* Added in the current function *)
+    val mutable deref_checks : (stmt * int * string) list = []; (* Not reported yet *)
+    val mutable bounds_checks : (stmt * int * string) list = []; (* Not reported yet *)
+    val mutable checks_dropped = 0;
+    val mutable checks_hoisted = 0;
+    val mutable mmio_reads = 0;
+    val mutable busy_waits = 0;
+    val mutable dma_syncs = 0;
+    val mutable dma_loop_maps = 0;
     val mutable num_bad_ptr_lvals = 0;
     val mutable return_on_device_error = 0;
-    val mutable locate_ret_call_count = 0;
+    val mutable ret_search_memo : (int * int * string, exp list * string * bool) Hashtbl.t =
+      Hashtbl.create 63; (* Results of locateretstmt_of in the current function *)
     val mutable lval_corrupt = ref 0;
     val mutable ret_seen = 0;
     val mutable pk_count = 0;
     val mutable pk_in_rtc = 0;
     val mutable brk_if = ref zero64Uexp;
+    val mutable nat_loops : nat_loop Inthash.t = Inthash.create 1; (* By header *)
     val mutable last_instr_loc = 0;
     val mutable ret_pk_count = 0;
     val mutable last_device_call_loc = 0;
-    val mutable goto_exp_flip = ref 0;
     val mutable last_array_device_call_loc = 0;
     val mutable report_timeout_counter : int = 0;
-    val mutable array_mask_set = ref "";
+    val mutable array_mask_set : ekey option ref = ref None;
+    val mutable merged_ticks = 0; (* Infinite polling loops found by the cache
+                                   * or by worker processes *)
+    val mutable fun_start_counts : finding_counts option = None;
+    val mutable fun_start_findings = 0;
     val mutable done_gen = ref 0; (* Variable to check if ticks code has already
                                    * been generated in a block *)
     val mutable done_ret_gen = ref 0;
@@ -781,9 +2936,6 @@ class driverVisitor = object (self) (* self is equivalent to this in Java/C++ *)
 
     val mutable done_add_ret = ref 0; (*Used to see if report code added or not. *) 
 
-    val mutable temp_bad_functions: string list =
-        [
-    ];
 
 
  (* Finds all the call lvals (variables) in a CIL instruction. *)
@@ -812,97 +2964,101 @@ class driverVisitor = object (self) (* self is equivalent to this in Java/C++ *)
      for i = 0 to List.length str_list -1  do
      if (!found < 0 ) then (
 	let cur_str = List.nth str_list i in
-        found := isbad cur_str [];
+        found := isbad cur_str no_names;
       );
     done;
      !found;
     end 
 
 
-   method find_lvals_exp (e:exp ) : string list = 
+   method find_vars_exp (e:exp ) : varinfo list = 
    begin
      match e with 
        | Lval(lh,_)  ->  
                (match lh with
                | Var (vinfo) ->
-                       vinfo.vname ::[];
+                       vinfo ::[];
                | Mem(ex) -> [];
                );
        | AddrOf(lv_inner) ->
                let (lh, _) = lv_inner in
                (match lh with
                | Var (vinfo)-> 
-                    vinfo.vname :: [];
+                    vinfo :: [];
                | Mem(ex) -> [];              
                );
         | BinOp (b, e1, e2, typ) ->
-                (self#find_lvals_exp e1)@(self#find_lvals_exp e2);
+                (self#find_vars_exp e1)@(self#find_vars_exp e2);
         | UnOp (op, e, typ) ->
-                (self#find_lvals_exp e);
+                (self#find_vars_exp e);
         | CastE (typ, e) ->
-                (self#find_lvals_exp e);
+                (self#find_vars_exp e);
         | SizeOfE (e) ->
-                (self#find_lvals_exp e); 
+                (self#find_vars_exp e); 
         | AlignOfE(e) ->
-                (self#find_lvals_exp e);
+                (self#find_vars_exp e);
    
        | _ -> [];
    end
+
+   (* Names of the variables found by find_vars_exp. *)
+   method find_lvals_exp (e:exp ) : string list =
+     List.map (fun v -> v.vname) (self#find_vars_exp e)
     
-   method find_lvals_exp_array (e:exp ) : string list =
+   method find_lvals_exp_array (e:exp ) : varinfo list =
    begin
      match e with
        | Lval(lh,_)  ->
                (match lh with
                | Var (vinfo) ->
-                       vinfo.vname ::[];
+                       vinfo ::[];
                | Mem(ex) -> [];
                );
        | AddrOf(lv_inner) ->
                let (lh, _) = lv_inner in
                (match lh with
                | Var (vinfo)->
-                    vinfo.vname :: [];
+                    vinfo :: [];
                | Mem(ex) -> [];
                );
         | BinOp (b, e1, e2, typ) -> if ((b != LAnd) && (b != BAnd)) then (
-                (self#find_lvals_exp e1)@(self#find_lvals_exp e2)) else [];
+                (self#find_vars_exp e1)@(self#find_vars_exp e2)) else [];
         | UnOp (op, e, typ) ->
-                (self#find_lvals_exp e);
+                (self#find_vars_exp e);
         | CastE (typ, e) ->
-                (self#find_lvals_exp e);
+                (self#find_vars_exp e);
         | SizeOfE (e) ->
-                (self#find_lvals_exp e);
+                (self#find_vars_exp e);
         | AlignOfE(e) ->
-                (self#find_lvals_exp e);
+                (self#find_vars_exp e);
 
        | _ -> [];
    end
 
  
 
- (* Finds all the lvals (string) in a CIL expression (hopefully). 
+ (* Finds all the variables in a CIL expression (hopefully). 
    * Also return lvals found in offset of lval in expression.
    *  *)
-   method find_lvals_exp_with_offset (e:exp ) : string list =
+   method find_lvals_exp_with_offset (e:exp ) : varinfo list =
    begin
      match e with
        | Lval(lh,o)  ->
                (match lh with
                | Var (vinfo) ->
-                       vinfo.vname ::(self#find_lvals_offset o);
+                       vinfo ::(self#find_lvals_offset o);
                | Mem(ex) -> (self#find_lvals_offset o);
                );
        | AddrOf(lv_inner) -> 
                let (lh, o) = lv_inner in
                (match lh with
                | Var (vinfo)->
-                    vinfo.vname :: (self#find_lvals_offset o);
+                    vinfo :: (self#find_lvals_offset o);
                | Mem(ex) -> (self#find_lvals_offset o);
                );
         | BinOp (b, e1, e2, typ) -> (
 		let str_list = ref [] in 
-		if ((b = LAnd) || (b = BAnd) ) then (Hashtbl.add hist_array_dirty ((exp_to_string e) , curr_func.svar.vname) "yes"; ) 
+		if ((b = LAnd) || (b = BAnd) ) then (Hashtbl.add hist_array_dirty (exp_tkey e curr_func) (); ) 
 		else ( 
 	(*	
 		  if ((b= Shiftlt) || (b = Shiftrt)) then (
@@ -928,31 +3084,40 @@ class driverVisitor = object (self) (* self is equivalent to this in Java/C++ *)
 		!str_list;	
 		);
         | UnOp (op, e, typ) ->
-                (self#find_lvals_exp e);
+                (self#find_vars_exp e);
         | CastE (typ, e) ->
-                (self#find_lvals_exp e);
+                (self#find_vars_exp e);
         | SizeOfE (e) ->
-                (self#find_lvals_exp e);
+                (self#find_vars_exp e);
         | AlignOfE(e) ->
-                (self#find_lvals_exp e);
+                (self#find_vars_exp e);
 	| StartOf(lv_inner) ->
                let (lh, o) = lv_inner in
                (match lh with
                | Var (vinfo)->
-                    vinfo.vname :: (self#find_lvals_offset o);
+                    vinfo :: (self#find_lvals_offset o);
                | Mem(ex) -> (self#find_lvals_offset o);
                );
         | _ -> [];
    end
 
-  (* Finds all lvals (string) in an offset. *)
-  method find_lvals_offset (o: offset) : string list =
+  (* Finds all variables in an offset. *)
+  method find_lvals_offset (o: offset) : varinfo list =
   begin
       match o with
       | Index(e,o2) -> (self#find_lvals_exp_with_offset e) @ (self#find_lvals_offset o2);
       | _ -> [];
   end
 
+  (* The variable last assigned by a Set is masked or constant, so its
+   * uses as an array index are safe. *)
+  method mark_array_mask_set () : unit =
+  begin
+    match !array_mask_set with
+    | Some k -> Hashtbl.add hist_array_dirty (k, curr_func.svar.vid) ()
+    | None -> ()
+  end
+
  (* Finds all the array lvals in a CIL expression (hopefully). 
    *  Do we need to add Const here ?? FIXME 
    *  *)
@@ -985,12 +3150,10 @@ class driverVisitor = object (self) (* self is equivalent to this in Java/C++ *)
                 ( (* Printf.fprintf stderr "ERE BINOP.\n";*)
 		if ((b = LAnd) || (b = BAnd) ) then ( 
                 (* Printf.fprintf stderr " ADDING %s %s\n\n" (exp_to_string e1) (!array_mask_set); *)
-		let str_list = self#find_lvals_exp e in
-		for i = 0 to List.length str_list -1 do
-		let cur_e = List.nth str_list i in
-			Hashtbl.add hist_array_dirty ((cur_e) , curr_func.svar.vname) "yes";
-		done;
-		Hashtbl.add hist_array_dirty (!array_mask_set, curr_func.svar.vname) "yes"; 
+		let var_list = self#find_vars_exp e in
+		List.iter (fun v ->
+			Hashtbl.add hist_array_dirty (var_tkey v curr_func) ()) var_list;
+		self#mark_array_mask_set (); 
 		);
 		self#find_array_lval_list_from_exp e1)@(self#find_array_lval_list_from_exp e2);) 
      | UnOp (op, e, typ) ->
@@ -1012,7 +3175,7 @@ class driverVisitor = object (self) (* self is equivalent to this in Java/C++ *)
          end     
         | _ -> [];
        end  
-     | Const(_) -> ( (*Printf.fprintf stderr"const set %s.\n" !array_mask_set;*)  Hashtbl.add hist_array_dirty (!array_mask_set, curr_func.svar.vname) "yes"; [];)              
+     | Const(_) -> ( self#mark_array_mask_set (); [];)              
      | _ -> [];
    end
 
@@ -1031,15 +3194,15 @@ class driverVisitor = object (self) (* self is equivalent to this in Java/C++ *)
     match i with
         | Call(lval_option,exp,e_list,l) ->
           begin
-	     let e1 = (exp_to_string exp) in
+	     let e1 = (call_name exp) in
 	     last_array_device_call_loc <- -1;
-             if (isbad e1 [] == 1) then      (
+             if (isbad e1 no_names == 1) then      (
                	
 		match lval_option with
 		| Some (lv) ->
 	         begin
 	        	match lv with
-			| (Var(var),_) -> Hashtbl.remove hist_array_dirty (var.vname, curr_func.svar.vname);
+			| (Var(var),_) -> Hashtbl.remove hist_array_dirty (var_tkey var curr_func);
 			| _ -> Hashtbl.clear hist_array_dirty;
 		end
 		|_ -> Hashtbl.clear hist_array_dirty;
@@ -1064,7 +3227,7 @@ class driverVisitor = object (self) (* self is equivalent to this in Java/C++ *)
 	  begin
             match lv with
 	      | (Var(var),_) -> begin
-		array_mask_set := var.vname;
+		array_mask_set := Some (var_key var);
 		match var.vtype with
 		| TArray(_,_,_) -> (lv :: (self#find_array_lval_list_from_exp exp); )
                 | _ -> (self#find_array_lval_list_from_exp exp);
@@ -1075,21 +3238,13 @@ class driverVisitor = object (self) (* self is equivalent to this in Java/C++ *)
    end
 
   (* Find if an lval is contaminated *)
-  method is_lval_cont (name: string) : bool = 
+  method is_lval_cont (v: varinfo) : bool = 
   begin
-	try
-	  let ret_str = (Hashtbl.find dirrrty (name, curr_func.svar.vname)) in
-	    begin
-(*		Printf.fprintf stderr 
-			"\nContaminated array index (vname, function, contaminated exp): %s, %s, %s\n"
-			name curr_func.svar.vname ret_str;	*)
-		true;
-	    end
-        with Not_found -> false;
+	(Hashtbl.mem dirrrty (var_tkey v curr_func));
   end
 
   (* Find if any lval in an lval list is contaminated *)
-  method is_lval_list_cont (lval_list: string list) : bool =
+  method is_lval_list_cont (lval_list: varinfo list) : bool =
   begin
 	match lval_list with
 	| hd_lval :: tl_lval_list -> 
@@ -1101,23 +3256,18 @@ class driverVisitor = object (self) (* self is equivalent to this in Java/C++ *)
   (* Find if an array offset expression is contaminated *)
    method is_exp_cont (e: exp) : bool =
    begin
-	let incoming_exp = (exp_to_string e) in
         if (last_array_device_call_loc = 0) then
 	(false;)
         else	
-        try ( 
-        let ret_str = (Hashtbl.find hist_array_dirty (incoming_exp ,curr_func.svar.vname)) in
-                (* Printf.fprintf stderr "Array History Match %s.\n" ret_str;  *)
-                false;
-        );
-        with Not_found -> (
-         (
-		Hashtbl.add hist_array_dirty (incoming_exp , curr_func.svar.vname) "yes";
+	let incoming_key = (exp_tkey e curr_func) in
+        if (Hashtbl.mem hist_array_dirty incoming_key) then
+                false
+        else (
+		Hashtbl.add hist_array_dirty incoming_key ();
 	
         let lval_list = (self#find_lvals_exp_with_offset e) in
 		(self#is_lval_list_cont lval_list);
 	);
-	);
    end
 
   (* Find if an array offset is contaminated *)
@@ -1257,17 +3407,15 @@ class driverVisitor = object (self) (* self is equivalent to this in Java/C++ *)
            match lhost with
            | Var(vinfo) ->	(
 	       if (isPointerType (typeOfLval cur_lv)) then (
-	   try
-	     let ret_str = (Hashtbl.find dirrrty (vinfo.vname, curr_func.svar.vname)) in
+	   if (Hashtbl.mem dirrrty (var_tkey vinfo curr_func)) then
               begin
-               	(* Printf.fprintf stderr "Culprit %s %s.\n" vinfo.vname ret_str; *)
-		try 
-		   let  ret_str = (Hashtbl.find  ptr_seen_before (vinfo.vname, curr_func.svar.vname)) in
+		if (Hashtbl.mem ptr_seen_before (var_tkey vinfo curr_func)) then (
 	        	num_bad_ptr_lvals <- num_bad_ptr_lvals + 1;
-				error_line_nos := !error_line_nos@[(Printf.sprintf "npa:%d"!cur_l)];
-	 	with Not_found -> Hashtbl.add ptr_seen_before (vinfo.vname, curr_func.svar.vname) "yes";	
+				self#report "reused_pointer" !cur_l
+				  (exp_to_string (Hashtbl.find dirrrty (var_tkey vinfo curr_func))) "none";
+		)
+	 	else Hashtbl.add ptr_seen_before (var_tkey vinfo curr_func) ();	
               end
-	      with Not_found -> ();
 	   )
 	   )
 	  |_ -> ();
@@ -1352,7 +3500,7 @@ class driverVisitor = object (self) (* self is equivalent to this in Java/C++ *)
 		                     (match host with
 			                 | Var  (vi) ->
                         			 begin
-                        			      if (self#iscounter (exp_to_string e) s = 1) then
+                        			      if (self#iscounter (counter_name e) s = 1) then
                         		              begin
                         		                  rc_list := vi.vname::!rc_list;
                         		                 
@@ -1428,104 +3576,15 @@ class driverVisitor = object (self) (* self is equivalent to this in Java/C++ *)
                        | Set (l,e, loc) ->
                          begin
                            match e with
-                            BinOp (b, e1, e2, typ) ->
-                            begin
-                                 match typ with
-                                    (* TInt (ik, a) -> *)
-                                    |_ ->    
-                                    begin    
-                                  (* Printf.fprintf stderr "Tint:%s\n"
-                                 (instr_to_string cur_instr);
-                                   Printf.fprintf stderr "Expressions are %s and
-                                   %s ..\n" (exp_to_string e1) (exp_to_string
-                                   e2); *) 
-                                    (* Printf.fprintf stderr "\n#NOTE: COUNTER IS %s %s.\n\n"
-                                    (exp_to_string e1) (exp_to_string e2); *)
-
-				   if ((String.compare (exp_to_string e1) "jiffies" = 0) || (String.compare (exp_to_string e2) "jiffies" = 0))
-				   then	rc_list := "jiffies" :: !rc_list;
-                                   if ( (String.compare (exp_to_string e1) "1" =
-                                       0) || (String.compare (exp_to_string e1)
-                                       "1U" = 0) || (String.compare (exp_to_string e1) "1L" = 0)  
-					|| (String.compare (exp_to_string e1) "1UL" = 0))
-                                   then (
-                                       rc_list := (exp_to_string e2)::!rc_list;
-                                       (* Printf.fprintf stderr "Added counter smthing"; *)
-                                   )
-                                   else (
-                                       if ((String.compare (exp_to_string e2) "1"
-                                       = 0) ||  (String.compare (exp_to_string
-                                       e2) "1U" = 0) || (String.compare (exp_to_string e2) "1L" = 0) || (String.compare (exp_to_string e2) "1UL" = 0))
-                                       then (
-                                           rc_list := (exp_to_string
-                                           e1)::!rc_list;
-                                            (* Printf.fprintf stderr "Added counter
-                                            smthing %s.\n " (exp_to_string e1);
-										    *)
-                                       )
-                                        );
-                                     end
-                                    
-                                    (* | _ -> Printf.fprintf stderr "OTHER
-                                     * RETURN TYPE"; *)
-                            end
-                       | CastE (t, ec) -> 
-                          begin
-                              match ec with 
-                                BinOp (b, e1, e2, typ) ->
-                                  begin
-                                      match typ with
-                                          (* TInt (ik, a) -> *)
-                                          | _ ->
-                                          begin   
-					  if ((String.compare (exp_to_string e1) "jiffies" = 0) || (String.compare (exp_to_string e2) "jiffies" = 0))
-                                            then rc_list := "jiffies" :: !rc_list;
-                                          if ((String.compare (exp_to_string e1) "1" = 0) || (String.compare (exp_to_string e1)
-                                       "1U" = 0) || (String.compare (exp_to_string e1) "1L" = 0) || (String.compare (exp_to_string e1) "1UL" = 0))
-
-                                          then (
-                                              let clstr = ref "" in
-                                              let ipstr = ref "" in
-                                              clstr := (exp_to_string e2);
-                                              (try 
-                                                  ipstr := String.sub !clstr
-                                              (String.rindex !clstr ')' + 1)
-                                          ((String.length !clstr - 1) -
-                                          (String.rindex !clstr ')') );
-                                              rc_list := !ipstr::!rc_list;
-                                               with Not_found -> rc_list :=
-                                                  (exp_to_string
-                                                  e2)::!rc_list; );
-                                          )
-                                          else (
-                                          if ((String.compare (exp_to_string e2) "1" = 0) || (String.compare (exp_to_string e2)
-                                       "1U" = 0) || (String.compare (exp_to_string e2) "1L" = 0) || (String.compare (exp_to_string e2) "1UL" = 0))
-
-                                          then (
-                                              let clstr = ref "" in
-                                              let ipstr = ref "" in
-                                              clstr := (exp_to_string e1);
-                                              (try 
-                                              ipstr := String.sub !clstr
-                                              (String.rindex !clstr ')' + 1)
-                                           ((String.length !clstr - 1) -
-                                           (String.rindex !clstr ')') );
-                                              rc_list := !ipstr::!rc_list;
-                                              (* Printf.fprintf stderr "Added counter
-                                              smthing %s.\n " (exp_to_string e1); *)
-                                              with Not_found -> rc_list :=
-                                                  (exp_to_string
-                                                  e1)::!rc_list; );
-                                          )
-                                          );
-                                          end
-                                    
-                                         (* | _ -> (); *)
-                               end
-                               | _ -> ();
-                          end
-                            | _ -> ();
-                       end
+                           | BinOp (_, e1, e2, _) | CastE (_, BinOp (_, e1, e2, _)) ->
+                               if (is_jiffies e1) || (is_jiffies e2) then
+                                 rc_list := "jiffies" :: !rc_list;
+                               if (is_one e1) then
+                                 rc_list := (counter_name e2) :: !rc_list
+                               else if (is_one e2) then
+                                 rc_list := (counter_name e1) :: !rc_list;
+                           | _ -> ();
+                         end
                        |_ -> ();
                    done;
                 end
@@ -1564,164 +3623,17 @@ class driverVisitor = object (self) (* self is equivalent to this in Java/C++ *)
                 done;
        !rc_list;
    end 
-   method locatestmt (b : block) (str:string) : exp list ref * string =
-   begin
-     let goto_label = ref "" in
-     let ret_list = ref []  in
-     (* let ret_str = ref "" in  *)
-     let expr_list = ref[] in
-     let e1 = ref zero64Uexp in
-     for i = 0 to (List.length b.bstmts) - 1 do
-       let cur_stmt  = (List.nth b.bstmts i) in
-       match cur_stmt.skind with
-
-         If(exp,block,block2,loc) ->
-          begin
-          (* match breakstmt with 
-           Printf.fprintf stderr "****Expr: %s.\n" (exp_to_string exp);  
-          (*expr_list := (list_append !expr_list exp); *)
-           Printf.fprintf stderr "Block stmts 1:  %s.\n" (stmt_list_to_string
-           block.bstmts);
-           Printf.fprintf stderr "Block stmts 2: %s.\n" (stmt_list_to_string block2.bstmts);
-          *)
-           
-           let (f_list, ret_str) =  (self#locatestmt block str) in
-           (*  Printf.fprintf stderr "******Comaparing %s %s for %s.******\n" 
-                                         str !ret_str (exp_to_string exp);   *)
-
-           if (String.compare str ret_str = 0) then
-              begin
-		  if (!goto_exp_flip = 1) then (
-			e1 := UnOp(LNot, exp , typeOf exp); 
-			goto_exp_flip := 0;
-		  ) 
-		  else e1 := exp;
-                  expr_list := (list_append !expr_list !e1);
-                  ret_list := !(f_list); 
-                  expr_list := (!expr_list@(!ret_list));
-                  goto_label := ret_str;
-		  brk_if := exp;
-              end;
-            
- 	  let (s_list, ret_str) =  (self#locatestmt block2 str) in 
-          (* Printf.fprintf stderr "******Comaparing %s %s for %s.******\n"
-                                        str !ret_str (exp_to_string exp);  *)
-
-          if (String.compare str ret_str = 0) then
-              begin
-	      if (!goto_exp_flip = 1) then (
-	        e1 := UnOp(LNot, exp , typeOf exp);
-		goto_exp_flip := 0;
-		)
-	      	else e1 := exp;
-
-                 expr_list := (list_append !expr_list !e1);
-                 ret_list := !(s_list);
-                 expr_list := (!expr_list@(!ret_list));
-                 goto_label := ret_str;
-		 brk_if := exp;
-              end;
-          end
-   
-
-       | Goto(stat_ref,location) ->
-               begin 
-                  (* Printf.fprintf stderr "Statement reference is %s.\n"
-                   (stmt_to_string !stat_ref) ; *)
-		 	(* 	Printf.fprintf stderr "Saw a goto.\n"; *)
-                 goto_label := String.sub (stmt_to_string !stat_ref) 0
-                   (String.index (stmt_to_string !stat_ref) ':');
-		  goto_exp_flip := 1;
-                  (* Printf.fprintf stderr "Goto label is %s.\n" !goto_label; *)
-                 if (String.compare str !goto_label != 0) then
-                     begin
-                         (*Printf.fprintf stderr "This is where our analysis is sound but
-                         not complete."; XXX FIXME *) 
-	               goto_label := str;
-                        
-                     end;
-                 (* if goto_label leads to str then make goto_label=str*)
-               end 
-
-
-       | Return(Some e, location) ->
-              begin
-                  goto_label := str; (*FIXME Treated as a successful goto *)
-              end 
-           
-       | _ -> ();
-       done;
-      (expr_list , !goto_label);
-   end
 
+   (* Whether a statement of b after the statement ssid has a report call *)
    method locateprintkstmt (b: stmt list)( ssid :int) : int =
    begin
-     let found = ref 0 in
-   (*   Printf.fprintf stderr "\n%%%%%%%%%%In locateprintstmt %%%%%% \n";
-     Printf.fprintf stderr "Block stmts 1:  %s.\n" (stmt_list_to_string
-           b); *)
-        
-     for i = 0 to (List.length b) - 1 do
-     let cur_stmt  = (List.nth b i) in
-     let match_regexp = regexp (".*"^"printk"^".*") in 
-     if (cur_stmt.sid > ssid) then ( 
-
-     match cur_stmt.skind with  
-
-    | Instr (ilist) ->
-         for i = 0 to (List.length ilist) -1 do
-         let cur_i = (List.nth ilist i) in
-         match cur_i with
-              | Call (_,e, el, loc) -> if (((String.compare (exp_to_string e) "printk") = 0)
-                                       ||((Str.string_match match_regexp (exp_to_string e) 0) = true))  then found:= 1;
-              | _ -> ();
-        done;
-     | If(e,b1,b2,l) -> found := (self#locateprintk b1) +  (self#locateprintk b2);
-     | Loop (b1,l,_,_) -> found := self#locateprintk b1;
-     | Block (b1) -> found := self#locateprintk b1;
-     | Switch (e,b1,_,l) -> found := self#locateprintk b1; 
-     | TryFinally (b1, b2, l) ->  found := (self#locateprintk b1) +  (self#locateprintk b2);
-     | TryExcept (b1, _, b2, _) -> found := (self#locateprintk b1) +  (self#locateprintk b2);
-     | _ -> ();
-	
-     );
-      done;
-       (* Printf.fprintf stderr "\n+++PRINTK found returns %d+++.\n" !found; *)
-    
-      !found;
+     if List.exists (fun s -> s.sid > ssid && stmt_has_report s) b then 1 else 0
    end
 
- 
+   (* Whether b has a report call, 1 or 0 *)
    method locateprintk (b: block) : int =
    begin
-     let found = ref 0 in
-     (* Printf.fprintf stderr "\n%%%%%%%%%%In locateprintstmt %%%%%% \n";
-     Printf.fprintf stderr "Block stmts 1:  %s.\n" (stmt_list_to_string
-           b.bstmts);
-	*)
-     for i = 0 to (List.length b.bstmts) - 1 do
-     let cur_stmt  = (List.nth b.bstmts i) in
-     let match_regexp = regexp (".*"^"printk"^".*") in
-     let match_regexp2 = regexp (".*"^"dev_warn"^".*") in
-     let match_regexp3 = regexp (".*"^"dev_info"^".*") in
-	 match cur_stmt.skind with
-  
-    | Instr (ilist) ->
-         for i = 0 to (List.length ilist) -1 do
-         let cur_i = (List.nth ilist i) in
-         match cur_i with
-              | Call (_,e, el, loc) -> if ( ((String.compare (exp_to_string e) "printk") = 0)||((Str.string_match match_regexp (exp_to_string e) 0) = true) || ((Str.string_match match_regexp2 (exp_to_string e) 0) = true) || ((Str.string_match match_regexp3 (exp_to_string e) 0) = true)      )  then (found:= 1;);
-	      | _ -> ();
-	done;
-     | If(e,b1,b2,l) -> found := !found + (self#locateprintk b1) +  (self#locateprintk b2); 
-     | Loop (b1,l,_,_) -> found := !found + self#locateprintk b1;
-     | Block (b1) -> found :=  !found + self#locateprintk b1;
-     | Switch (e,b1,_,l) -> found := !found + self#locateprintk b1;
-     | TryFinally (b1, b2, l) ->  found := !found + (self#locateprintk b1) +  (self#locateprintk b2);
-     | TryExcept (b1, _, b2, _) -> found := !found + (self#locateprintk b1) +  (self#locateprintk b2);  
-     | _ -> ();
-      done;
-      !found;
+     if block_has_report b then 1 else 0
    end
    
   method addreportcode (b: block) : unit =
@@ -1736,6 +3648,7 @@ class driverVisitor = object (self) (* self is equivalent to this in Java/C++ *)
     let logg_stmt =  mkStmtOneInstr (Call(None,
              (expify_fundec log_call_fundec),!args_list, locUnknown)) in
     b.bstmts <- [logg_stmt]@b.bstmts  ;
+    note_report_added b;
     );
     done_add_ret := 1
   end
@@ -1746,21 +3659,13 @@ class driverVisitor = object (self) (* self is equivalent to this in Java/C++ *)
      let ret_list = ref []  in
      (* let ret_str = ref "" in *)
      let expr_list = ref[] in
-     (* Printf.fprintf stderr "In locateretstmt. %d\n" locate_ret_call_count; *)
-     locate_ret_call_count <- locate_ret_call_count + 1;
       (* Printf.fprintf stderr "Block stmts %s.\n" (stmt_list_to_string
      b.bstmts);  *)
      
-    if (locate_ret_call_count > 10000)
-	 then Printf.printf  "TIMEOUT COUNTDOWN.\n";
-    if (locate_ret_call_count < 10000)
-	then	( 
- 
-     for i = 0 to (List.length b.bstmts) - 1 do
-       let cur_stmt  = (List.nth b.bstmts i) in
+     List.iter (fun cur_stmt ->
        match cur_stmt.skind with
 
-      | Block (b1) -> ( let (e_list , g_label) = (self#locateretstmt b1 str) in (expr_list := !e_list; goto_label := g_label;  )  );  
+      | Block (b1) -> ( let (e_list , g_label) = (self#locateretstmt_of cur_stmt 0 b1 str) in (expr_list := !e_list; goto_label := g_label;  )  );  
       | Instr (ilist) ->
 	  for i = 0 to (List.length ilist) -1 do
 	  let cur_i = (List.nth ilist i) in 
@@ -1780,8 +3685,8 @@ class driverVisitor = object (self) (* self is equivalent to this in Java/C++ *)
                   | Const (con) -> (
                         (* Printf.fprintf stderr "ZZZZCCC"; *)
                         match con with
-                        | CInt64 (i, ik, Some s) -> ( if (i < (Int64.of_int 0)) then ( goto_label := str;ret_seen <- ret_seen + 1; pk_count <- pk_count + self#locateprintk b; self#addreportcode b; error_line_nos := !error_line_nos@[(Printf.sprintf "Missing report:%d"loc.line)];))
-                        | CInt64 (i, ik, None) -> ( if (i < (Int64.of_int 0)) then (goto_label := str;ret_seen <- ret_seen + 1; pk_count <- pk_count + self#locateprintk b; self#addreportcode b; error_line_nos := !error_line_nos@[(Printf.sprintf "Missing report:%d"loc.line)];  ));
+                        | CInt64 (i, ik, Some s) -> ( if (i < (Int64.of_int 0)) then ( goto_label := str;ret_seen <- ret_seen + 1; pk_count <- pk_count + self#locateprintk b; self#addreportcode b; self#report "missing_error_report" loc.line "" "report";))
+                        | CInt64 (i, ik, None) -> ( if (i < (Int64.of_int 0)) then (goto_label := str;ret_seen <- ret_seen + 1; pk_count <- pk_count + self#locateprintk b; self#addreportcode b; self#report "missing_error_report" loc.line "" "report";  ));
                         | CEnum(_, _, _) -> ();
                         | CReal (_, _, _) -> ();
                         | CChr (chr) -> ();
@@ -1791,7 +3696,7 @@ class driverVisitor = object (self) (* self is equivalent to this in Java/C++ *)
                   );
                   | UnOp (u, e1, t) -> (
                         match u with
-                        | Neg -> (goto_label := str; ret_seen <- ret_seen + 1; pk_count <- pk_count + self#locateprintk b; self#addreportcode b; error_line_nos := !error_line_nos@[(Printf.sprintf "Missing report:%d"loc.line)];);
+                        | Neg -> (goto_label := str; ret_seen <- ret_seen + 1; pk_count <- pk_count + self#locateprintk b; self#addreportcode b; self#report "missing_error_report" loc.line "" "report";);
                         | _ -> ();
                   );
                   | _ -> ();
@@ -1805,7 +3710,7 @@ class driverVisitor = object (self) (* self is equivalent to this in Java/C++ *)
       |    If(exp,block,block2,loc) ->
           begin
 
-	   let (s_list, ret_str) =  (self#locateretstmt block str) in
+	   let (s_list, ret_str) =  (self#locateretstmt_of cur_stmt 0 block str) in
 	
            if (String.compare str ret_str = 0) then
               begin
@@ -1815,7 +3720,7 @@ class driverVisitor = object (self) (* self is equivalent to this in Java/C++ *)
                   goto_label := ret_str;
               end;
 	  
-	  let (s_list, ret_str) =  (self#locateretstmt block2 str) in
+	  let (s_list, ret_str) =  (self#locateretstmt_of cur_stmt 1 block2 str) in
           (* Printf.fprintf stderr "******Comaparing %s %s for %s.******\n"
                                         str !ret_str (exp_to_string exp);  *)
 
@@ -1831,10 +3736,10 @@ class driverVisitor = object (self) (* self is equivalent to this in Java/C++ *)
 	
        | Goto(stat_ref,location) ->
                begin
-                  (* Printf.fprintf stderr "Statement reference is %s.\n"
-                   (stmt_to_string !stat_ref) ; *)
-                 goto_label := String.sub (stmt_to_string !stat_ref) 0
-                   (String.index (stmt_to_string !stat_ref) ':');
+                 (* The name of the label the goto jumps to *)
+                 (match !stat_ref.labels with
+                  | Label(name, _, _) :: _ -> goto_label := name
+                  | _ -> ());
                   (* Printf.fprintf stderr "Goto label is %s.\n" !goto_label; *)
                  (* if goto_label leads to str then make goto_label=str*)
                end
@@ -1873,138 +3778,54 @@ class driverVisitor = object (self) (* self is equivalent to this in Java/C++ *)
                   (*FIXME Treated as a successful goto *)
               end
 
-       | _ -> ();
-       done;
-      );
+       | _ -> ()) b.bstmts;
        Hashtbl.add locateexplist (ref b) !expr_list ;
       (expr_list , !goto_label);
    end
+
+   (* locateretstmt on block n (0 = then, 1 = else, 2 = loop body) of s,
+    * memoized by statement id and target. Nested ifs are searched, and their
+    * error returns counted and reported, once per target instead of once per
+    * enclosing if, so the search is linear in the size of the function. *)
+   method locateretstmt_of (s: stmt) (n: int) (b: block) (str: string) : exp list ref * string =
+   begin
+     if s.sid < 0 then self#locateretstmt b str (* Added by us, no id *)
+     else
+       let key = (s.sid, n, str) in
+       try
+         let (e_list, g_label, found) = Hashtbl.find ret_search_memo key in
+         if found then done_add_ret := 1;
+         (ref e_list, g_label)
+       with Not_found ->
+         let before = !done_add_ret in
+         done_add_ret := 0;
+         let (e_list, g_label) = self#locateretstmt b str in
+         let found = (!done_add_ret = 1) in
+         if not found then done_add_ret := before;
+         Hashtbl.add ret_search_memo key (!e_list, g_label, found);
+         (e_list, g_label)
+   end
   
  
-   (* Visits every "statement" *)
-   method vstmt (s: stmt) : stmt visitAction =
+   (* The infinite polling check of one loop. s is its header and b its body
+    * (or, for a goto loop, a block of its outermost statements), expr_list the
+    * conditions under which it is left. The report and the ticks code are put
+    * in with put_first and put_last. *)
+   method check_polling_loop (s: stmt) (b: block) (ln: location) (expr_list: exp list ref)
+       (put_first: stmt -> unit) (put_last: stmt -> unit) : unit =
    begin
-     (* let brk_if = ref zero64Uexp in *)
-     match s.skind with
-     Instr(ilist) ->
-       begin
-         let halting_found = ref 0 in
-            let shadow_call = ref dummyStmt in
-              for j = 0 to (List.length ilist) - 1 do
-              let cur_instr = (List.nth ilist j) in
-              match cur_instr with
-		(* Check if any calls to DMA/memory functions have tainted arguments *)
-                | Call(lvalue_option,e,el,loc) ->
-                    if (isdmacall (exp_to_string e) == 1) then
-                      begin
-                        for k = 0 to (List.length el) - 1 do
-                          let cur_e = (List.nth el k) in
-				let str_list_e = (self#find_lvals_exp cur_e) in
-				 for l = 0 to (List.length str_list_e) - 1 do  
-				  let str_le = (List.nth str_list_e l) in	
-                                  (* Printf.fprintf stderr "Arg: %s.\n" (str_le); *)
-                                  try
-                                   let ret_str = (Hashtbl.find dirrrty ((str_le), curr_func.svar.vname)) in
-			           dma_taint := !dma_taint + 1;
-                                   with Not_found -> ();
-                               done
-                           done;
-                          end;
-                |_ -> ();
-                done;
-          DoChildren;
-        end
-
-     | Loop(b,ln,Some labelstmt,Some breakstmt) ->
-        let break_label_list = ref [] in
         let counters_in_loop = ref [] in
-        (* Locate the *only* label *)   
-        for j = 0 to (List.length breakstmt.labels) - 1 do
-          let cur_label  = (List.nth breakstmt.labels j) in    
-            match cur_label with
-              Label(str,l, boo)  ->
-                begin   
-                  (* Printf.fprintf stderr "Label is %s.\n" str;  *)
-                  break_label_list := (list_append !break_label_list str);
-                  (*break_label := str;*)
-                end
-              | _ -> ();
-        done; 
-
-         
-        (* b.bstmts <- new_stmts; *)
-
-	     let expr_list = ref[]  in
-	   let e1 = ref zero64Uexp in
-           (*Printf.fprintf stderr "Executing for %n labels.\n" (List.length
-           !break_label_list) ; *)
-           for j = 0 to (List.length !break_label_list) - 1 do
-               let break_label = (List.nth !break_label_list j) in
-           for i = 0 to (List.length b.bstmts) - 1 do
-           let cur_stmt  = (List.nth b.bstmts i) in
-           (* Printf.fprintf stderr "Loop block statement : %s .\n Loop block
-            * stmt ends.\n" (stmt_to_string cur_stmt); *)
-	   match cur_stmt.skind with
-		   If(exp,block,block2,loc) ->
-		   begin
-		     (*  	match breakstmt with 
-			Printf.fprintf stderr "Expr: %s.\n" (exp_to_string exp); 
-            Printf.fprintf stderr "Block stmts %s.\n" (stmt_list_to_string
-            block2.bstmts);
-	               
-            ret_str :=  (snd (self#locatestmt block break_label)); *)
-	    brk_if := exp;
-	    let (f_list, ret_str) =  (self#locatestmt block break_label) in
-             (* Printf.fprintf stderr "******Comaparing %s %s for %s.******\n"
-            break_label !ret_str (exp_to_string exp);  *)
-            if (String.compare break_label ret_str = 0) then
-                begin
-                 if (!goto_exp_flip = 1) then (
-                        e1 := UnOp(LNot, exp , typeOf exp);
-                        goto_exp_flip := 0;
-                  )
-                  else e1 := exp;
-                    expr_list := (list_append !expr_list !e1);
-                    expr_list := !expr_list@(!f_list);
-                end;
-
-            let (s_list, ret_str) =  (self#locatestmt block2 break_label) in 
-            (* Printf.fprintf stderr "******Comaparing %s %s for %s.******\n"
-            break_label !ret_str (exp_to_string exp); 
-            *)
-            if (String.compare break_label ret_str = 0) then
-                begin
-                 if (!goto_exp_flip = 1) then (
-                        e1 := UnOp(LNot, exp , typeOf exp);
-                        goto_exp_flip := 0;
-                  )
-                  else e1 := exp;
-
-
-                    expr_list := (list_append !expr_list !e1);
-                    expr_list := !expr_list@(!s_list);
-                end;
-
-            (* Printf.fprintf stderr "|| Expr List follows: %s. End.\n||"
-            (exp_list_to_string !expr_list); *)
-
-            (* There is a BUG here that if there are duplicates in expr_list we
-            * may generate fixing code twice for it. So, a FIXME here is to
-            * strip expr_list of duplicates.
-            *)
-            end           
-            |_ -> ();
-           done;
-           done;
+        done_gen := 0;
 	    let ctr_string = ref "1" in	
             let ctr = ref "1" in 
-            let strlist = ref [] in
+            let varlist = ref [] in
             for k = 0 to (List.length !expr_list) - 1 do
                 begin
                   let expr = (List.nth !expr_list k) in
-                  strlist := List.append !strlist (self#find_lvals_exp expr);
+                  varlist := List.append !varlist (self#find_vars_exp expr);
                 end
             done;
+            let strlist = ref (List.map (fun v -> v.vname) !varlist) in
             strlist := "__nooks_timer" :: !strlist;
 	    strlist := "jiffies" :: !strlist;
 
@@ -2033,14 +3854,15 @@ class driverVisitor = object (self) (* self is equivalent to this in Java/C++ *)
                         
             if (!done_gen < 1) then (
                 (* TODO: Remove duplicates from strlist here. *)
-                for l = 0 to (List.length !strlist) - 1 do
-                    let cur_str = (List.nth !strlist l) in
+                for l = 0 to (List.length !varlist) - 1 do
+                    let cur_var = (List.nth !varlist l) in
+                    let cur_str = cur_var.vname in
                     if (!done_gen < 1) then                       (* Ensures ticks generated only
                                               * once in a while loop. *)
                     begin
                     (try
-                    let ret_str = (Hashtbl.find dirrrty
-                    (cur_str,curr_func.svar.vname)) in
+                    let ret_exp = (Hashtbl.find dirrrty
+                    (var_tkey cur_var curr_func)) in
                         (* Printf.fprintf stderr "fn(%s) NOT SAFE DETECTED mapping ->  %s for %s for %d.\n"
                         curr_func.svar.vname ret_str cur_str !block_count; *)
                         (* At this point we have the while loop, the conditions
@@ -2066,7 +3888,11 @@ class driverVisitor = object (self) (* self is equivalent to this in Java/C++ *)
 				 (* if (pk_in_rtc = 0) then (  *)
 				(*rtc_pk = self#locateprintk curr_func.sbody;*)	
 				let rtc_line_no = (Printf.sprintf "shadow rtc report line:%d pk %d\n" ln.line pk_in_rtc) in	
-				error_line_nos := !error_line_nos@[(Printf.sprintf "Missing timeout:%d"ln.line)];
+				self#report "missing_timeout_report" ln.line (exp_to_string ret_exp) "report";
+				self#check_busy_wait b ln.line
+				  (match counter_bound curr_func !expr_list !counters_in_loop with
+				   | Some n -> Some (BoundIters n)
+				   | None -> None);
 				let check_falseblock = (mkBlock [(mkEmptyStmt ())])  in 
 				let log_call_fundec = (emptyFunction "printk" ) in
 				let const = CStr (*"shadow rtc report.\n"::*) rtc_line_no  in
@@ -2084,13 +3910,13 @@ class driverVisitor = object (self) (* self is equivalent to this in Java/C++ *)
 				(* Locates an add on negative return and other condition and adds a printk. *)
 
 			        (* Commented to generate correct stats - Shoudl reamin uncommented. including below else *)	
-				self#locateretstmt b (exp_to_string !brk_if);
+				ignore (self#locateretstmt_of s 2 b (exp_to_string !brk_if));
  				
                                 if (!done_add_ret = 0) then  (
 					let temp_ret = ref (self#locateprintk b) in
 					(* Printf.fprintf stderr "\n++***********LOCATEPRINTK IS %d ************++\n" !temp_ret; *)
 					if (!temp_ret = 0) then (
-					b.bstmts <- [check_loop_if]@b.bstmts ;
+					put_first check_loop_if;
 					);
 				 ) 
 				 else ( return_on_device_error <- return_on_device_error - 1; ret_pk_count <- ret_pk_count - 1;); 
@@ -2160,9 +3986,21 @@ class driverVisitor = object (self) (* self is equivalent to this in Java/C++ *)
                           let check_falseblock = (mkBlock !false_stmt_list) in  
                           let snt_if = If(ticks_check, check_trueblock,
                           check_falseblock,locUnknown) in
+                          if (!guard_mode = GuardCount) then (
                           let stmt_if = (mkStmt snt_if) in
-                          b.bstmts <- list_append b.bstmts stmt_if;
-			  error_line_nos := !error_line_nos@[(Printf.sprintf "Infinite Loop:%d"ln.line)];
+                          put_last stmt_if;
+			  self#report "infinite_loop" ln.line (exp_to_string ret_exp) "ticks";
+			  self#check_busy_wait b ln.line (Some (BoundIters tickval));
+                          ) else (
+                          let (interval, ms) = guard_params curr_func.svar.vname ln.line in
+                          let deadline = makeLocalVar curr_func
+                            ("__shadow_deadline_"^(!ctr)^(string_of_int glob_ctr))
+                            (TInt(IULong, [])) in
+                          put_first (time_guard tickvar deadline interval ms
+                                       !false_stmt_list);
+			  self#report "infinite_loop" ln.line (exp_to_string ret_exp) "time_budget";
+			  self#check_busy_wait b ln.line (Some (BoundBudget ms));
+                          );
                           done_gen := 1;
                           )
                     with Not_found -> ();
@@ -2171,26 +4009,129 @@ class driverVisitor = object (self) (* self is equivalent to this in Java/C++ *)
                 done;
                 glob_ctr <- glob_ctr + 1; (* To maintain global uniqueness *)
             );
+   end
 
-          
+   (* Report the busy time of a polling loop with the given bound *)
+   method check_busy_wait (b: block) (line: int) (bound: busy_bound option) : unit =
+     let (per_iter, sites) = busy_delay b.bstmts in
+     match bound with
+     | Some bound when per_iter > 0 ->
+         let advice =
+           if Hashtbl.mem isr_context curr_func.svar.vid then ", in interrupt context"
+           else if per_iter >= sleep_threshold_ns then ", a sleeping wait would do"
+           else ""
+         in
+         let us =
+           match bound with
+           | BoundIters n -> per_iter * n / 1000
+           | BoundBudget ms -> ms * 1000
+         in
+         let source =
+           match bound with
+           | BoundIters n ->
+               Printf.sprintf "%d us: %s x %d iterations%s"
+                 us (String.concat " + " sites) n advice
+           | BoundBudget ms ->
+               Printf.sprintf "%d us: %s until the %d ms budget%s"
+                 us (String.concat " + " sites) ms advice
+         in
+         busy_waits <- busy_waits + 1;
+         self#report_cost "busy_wait" line source "none" us
+     | _ -> ()
+
+   (* The infinite polling check of the goto loops of the current function,
+    * in header order. The body passed to the check is made of the outermost
+    * statements of the loop. The code it adds goes in front of the header,
+    * where every iteration passes. *)
+   method check_goto_loops () : unit =
+   begin
+     let loops = Inthash.fold (fun _ l acc -> if is_goto_loop l then l :: acc else acc)
+                   nat_loops [] in
+     List.iter (fun l ->
+         let h = l.nl_header in
+         let outermost = List.filter (fun st ->
+             try not (Hashtbl.mem l.nl_ids (Hashtbl.find stmt_parent st.sid))
+             with Not_found -> true) l.nl_stmts in
+         let put (st: stmt) : unit =
+           h.skind <- Block (mkBlock [st; mkStmt h.skind]);
+           mark_report_added h.sid
+         in
+         let body = mkBlock outermost in
+         self#check_polling_loop h body (get_stmtLoc h.skind)
+           (ref l.nl_exits) put put;
+         (* The body is only a view of the loop, so the statements the
+          * search put at its front (the report of addreportcode) go before
+          * the header instead. *)
+         List.iter put
+           (List.rev (List.filter (fun st -> not (List.memq st outermost))
+                        body.bstmts)))
+       (List.sort (fun a b -> compare a.nl_header.sid b.nl_header.sid) loops);
+   end
+
+   (* Visits every "statement". The DMA argument check, the polling loop
+    * check and the error report search are timed apart (see --stats). *)
+   method vstmt (s: stmt) : stmt visitAction =
+     incr (Lazy.force statements_visited);
+     self#check_stmt s
+
+   method check_stmt (s: stmt) : stmt visitAction =
+   begin
+     (* let brk_if = ref zero64Uexp in *)
+     match s.skind with
+     Instr(ilist) ->
+       begin
+         let halting_found = ref 0 in
+            let shadow_call = ref dummyStmt in
+              for j = 0 to (List.length ilist) - 1 do
+              let cur_instr = (List.nth ilist j) in
+              match cur_instr with
+		(* Check if any calls to DMA/memory functions have tainted arguments *)
+                | Call(lvalue_option,e,el,loc) ->
+                    if (isdmacall (call_name e) == 1) then
+                      Stats.time "carb-dma-args" (fun () ->
+                        for k = 0 to (List.length el) - 1 do
+                          let cur_e = (List.nth el k) in
+				let var_list_e = (self#find_vars_exp cur_e) in
+				 for l = 0 to (List.length var_list_e) - 1 do  
+				  let var_le = (List.nth var_list_e l) in	
+                                  if (Hashtbl.mem dirrrty (var_tkey var_le curr_func)) then
+			           dma_taint := !dma_taint + 1;
+                               done
+                           done) ();
+                |_ -> ();
+                done;
+          DoChildren;
+        end
+
+     | Loop(b,ln,_,_) ->
+        (* The conditions under which the loop is left, read from the exiting
+         * edges of its natural loop (the Loop statement is the header). *)
+        let expr_list = ref (match Inthash.tryfind nat_loops s.sid with
+                             | Some l -> l.nl_exits
+                             | None -> []) in (* Unreachable *)
+        Stats.time "carb-polling" (fun () ->
+          self#check_polling_loop s b ln expr_list
+            (fun st -> b.bstmts <- st :: b.bstmts; note_report_added b)
+            (fun st -> b.bstmts <- list_append b.bstmts st; note_report_added b)) ();
 	    DoChildren; 
 	(* Here we look for all conditionals based on device values that return non-zero values. *) 
 	| If (exp,block,block2,loc) ->
 	       let if_bad = ref 0 in
 	       let done_check = ref 0 in	
-	       let strlist = ref [] in
-               strlist := List.append !strlist (self#find_lvals_exp exp);
-              (* TODO: Remove duplicates from strlist here. *)
-              for l = 0 to (List.length !strlist) - 1 do
-                   let cur_str = (List.nth !strlist l) in
+	       let varlist = ref [] in
+               varlist := List.append !varlist (self#find_vars_exp exp);
+              (* TODO: Remove duplicates from varlist here. *)
+              for l = 0 to (List.length !varlist) - 1 do
+                   let cur_var = (List.nth !varlist l) in
+                   let cur_str = cur_var.vname in
                    if (!done_check = 0) then
                    begin
-		    (* Printf.fprintf stderr "CHECKING FOR IF %s %d. \n\n\n" cur_str (isbad cur_str []); *)
-		    if (isbad cur_str [] = 1) then
+		    (* Printf.fprintf stderr "CHECKING FOR IF %s %d. \n\n\n" cur_str (isbad cur_str no_names); *)
+		    if (isbad cur_str no_names = 1) then
 			done_check := 1;
                   (try
-		    (* Printf.fprintf stderr "CHECKING FOR DIRRRTY %s %d. \n\n\n" cur_str (isbad cur_str []); *)
-                    let ret_str = (Hashtbl.find dirrrty (cur_str,curr_func.svar.vname)) in
+		    (* Printf.fprintf stderr "CHECKING FOR DIRRRTY %s %d. \n\n\n" cur_str (isbad cur_str no_names); *)
+                    let ret_exp = (Hashtbl.find dirrrty (var_tkey cur_var curr_func)) in
                         (* Printf.fprintf stderr "fn(%s) Return on not safe ->  %s for %s for %d.\n"
                         curr_func.svar.vname cur_str cur_str !block_count; *)
                         done_check := 1;
@@ -2212,7 +4153,8 @@ class driverVisitor = object (self) (* self is equivalent to this in Java/C++ *)
        		   end	   
         	with Not_found -> (
  
-			let (s_list, ret_str) =  (self#locateretstmt block !check_str) in
+			let (s_list, ret_str) =
+			  Stats.time "carb-error-reports" (self#locateretstmt_of s 0 block) !check_str in
 	                Hashtbl.add locateexplist (ref block) (list_append !s_list exp); 
 			(*	
 		Printf.fprintf stderr "Block stmts %s.\n" (stmt_list_to_string
@@ -2229,7 +4171,8 @@ class driverVisitor = object (self) (* self is equivalent to this in Java/C++ *)
 	                    expr_list := !expr_list@(!s_list);
         	        end;
 
-	                let (s_list, ret_str)  =  (self#locateretstmt block2 !check_str) in
+	                let (s_list, ret_str)  =
+	                  Stats.time "carb-error-reports" (self#locateretstmt_of s 1 block2) !check_str in
 		        Hashtbl.add locateexplist (ref block2) (list_append !s_list exp);	
                 	if (String.compare !check_str ret_str = 0) then
 	                begin
@@ -2246,19 +4189,19 @@ class driverVisitor = object (self) (* self is equivalent to this in Java/C++ *)
                (exp_list_to_string !expr_list2);
 
 	
-               let strlist = ref [] in
+               let varlist = ref [] in
                for k = 0 to (List.length !expr_list) - 1 do
                begin
                   let expr = (List.nth !expr_list k) in
-                  strlist := List.append !strlist (self#find_lvals_exp expr);
+                  varlist := List.append !varlist (self#find_vars_exp expr);
                end
               done;
 	
-	       let strlist2 = ref [] in
+	       let varlist2 = ref [] in
                for k = 0 to (List.length !expr_list2) - 1 do
                begin
                   let expr = (List.nth !expr_list2 k) in
-                  strlist2 := List.append !strlist2 (self#find_lvals_exp expr);
+                  varlist2 := List.append !varlist2 (self#find_vars_exp expr);
                end
               done;
 	
@@ -2266,14 +4209,15 @@ class driverVisitor = object (self) (* self is equivalent to this in Java/C++ *)
 	      let if_ret_gen = ref 0 in
               if (!done_ret_gen = 0) then (
               (* TODO: Remove duplicates from strlist here. *)
-              for l = 0 to (List.length !strlist) - 1 do
-                   let cur_str = (List.nth !strlist l) in
+              for l = 0 to (List.length !varlist) - 1 do
+                   let cur_var = (List.nth !varlist l) in
+                   let cur_str = cur_var.vname in
                    if (!done_ret_gen = 0) then           
                    begin
                   (try
-                    let ret_str = (Hashtbl.find dirrrty (cur_str,curr_func.svar.vname)) in
+                    let ret_exp = (Hashtbl.find dirrrty (var_tkey cur_var curr_func)) in
                         Printf.fprintf stderr "fn(%s) Return on not safe ->  %s for %s for %d.\n"
-                        curr_func.svar.vname ret_str cur_str !block_count;
+                        curr_func.svar.vname (exp_to_string ret_exp) cur_str !block_count;
 			(* Insert code before return -- now only does in enclosing if *)
 	                (*let log_call_fundec = (emptyFunction "printk" ) in
                         let const = CStr "shadow ret report.\n" in
@@ -2292,14 +4236,15 @@ class driverVisitor = object (self) (* self is equivalent to this in Java/C++ *)
 
               if (!done_ret_gen = 0) then (
               (* TODO: Remove duplicates from strlist here. *)
-              for l = 0 to (List.length !strlist2) - 1 do
-                   let cur_str = (List.nth !strlist2 l) in
+              for l = 0 to (List.length !varlist2) - 1 do
+                   let cur_var = (List.nth !varlist2 l) in
+                   let cur_str = cur_var.vname in
                    if (!done_ret_gen = 0) then
                    begin
                   (try
-                    let ret_str = (Hashtbl.find dirrrty (cur_str,curr_func.svar.vname)) in
+                    let ret_exp = (Hashtbl.find dirrrty (var_tkey cur_var curr_func)) in
                         Printf.fprintf stderr "fn(%s) Return on not safe ->  %s for %s for %d.\n"
-                        curr_func.svar.vname ret_str cur_str !block_count;
+                        curr_func.svar.vname (exp_to_string ret_exp) cur_str !block_count;
 
                         (* Insert code before return -- now only does in enclosing if 
                         let log_call_fundec = (emptyFunction "printk" ) in
@@ -2394,30 +4339,25 @@ class driverVisitor = object (self) (* self is equivalent to this in Java/C++ *)
 	   else ((mkEmptyStmt ()),false)
    end
 
-   (* Converts an instruction list to a statement list *)
+   (* Converts an instruction list to a statement list. The statements and
+    * the instructions of the current statement are accumulated in reverse. *)
    method get_stmt_list_from_instr_list (i_list: instr list) (labels: label list) : stmt list =
    begin
       let stmt_list = ref [] in
       let curr_instr_list = ref [] in
-	for i = 0 to (List.length i_list) - 1 do
-	  begin
-	    let (new_stmt,need_bounds_check) = (self#get_bounds_check_stmt (List.nth i_list i)) in
+	List.iter (fun i ->
+	    let (new_stmt,need_bounds_check) = (self#get_bounds_check_stmt i) in
 		if(need_bounds_check) 
 		then begin
-			let curr_stmt = mkStmt(Instr(!curr_instr_list)) in
-			  curr_stmt.skind <- Instr(!curr_instr_list);
-			  stmt_list := (List.append !stmt_list 
-					(List.append [curr_stmt] [new_stmt]));
-			  num_array_checks_added <- num_array_checks_added + 1;
-			  error_line_nos := !error_line_nos@[(Printf.sprintf "Static array:%d"last_array_device_call_loc)];
-			  curr_instr_list := [(List.nth i_list i)];
+			let curr_stmt = mkStmt(Instr(List.rev !curr_instr_list)) in
+			  stmt_list := new_stmt :: curr_stmt :: !stmt_list;
+			  self#add_bounds_check new_stmt last_array_device_call_loc
+			    (Pretty.sprint 100 (dn_instr () i));
+			  curr_instr_list := [i];
 		end
-		else curr_instr_list := (List.append !curr_instr_list [(List.nth i_list i)])
-	  end;
-	done;
-        let final_stmt = mkStmt(Instr(!curr_instr_list)) in	
-		final_stmt.skind <- Instr(!curr_instr_list);
-	let final_stmt_list = List.append !stmt_list [final_stmt] in
+		else curr_instr_list := i :: !curr_instr_list) i_list;
+        let final_stmt = mkStmt(Instr(List.rev !curr_instr_list)) in	
+	let final_stmt_list = List.rev (final_stmt :: !stmt_list) in
 		(List.hd final_stmt_list).labels <- labels;
 		final_stmt_list;
    end
@@ -2455,12 +4395,13 @@ class driverVisitor = object (self) (* self is equivalent to this in Java/C++ *)
                         if(List.length cont_array_lvals > 0) then
 			begin
 				
-				Hashtbl.add hist_array_dirty ((exp_to_string e) , curr_func.svar.vname) "yes";
+				Hashtbl.add hist_array_dirty (exp_tkey e curr_func) ();
 				let new_if_stmt = (mkStmt (If(e,b1,b2,l))) in
                  			new_if_stmt.skind <- If(e,b1,b2,l);
-					num_array_checks_added <- num_array_checks_added + 1;
-					error_line_nos := !error_line_nos@[(Printf.sprintf "arr:%d"last_array_device_call_loc)];
-                              		(self#get_stmt_from_if_stmt cont_array_lvals s.labels) :: [new_if_stmt];
+					let check = self#get_stmt_from_if_stmt cont_array_lvals s.labels in
+					self#add_bounds_check check last_array_device_call_loc
+					  (String.concat ", " (List.map lval_to_string cont_array_lvals));
+                              		check :: [new_if_stmt];
 			end
 			else [s]
            end
@@ -2519,19 +4460,9 @@ class driverVisitor = object (self) (* self is equivalent to this in Java/C++ *)
                 begin
 		last_instr_loc <- l.line;
 		last_device_call_loc <- 1;
-		let e1 = (exp_to_string ex) in
-		if (isbad e1 [] == 1) then	(
-         	match lv_option with
-                | Some (lv) ->
-                 begin
-                        match lv with
-                        | (Var(var),_) -> Hashtbl.remove hist_dirty (var.vname, curr_func.svar.vname);
-                        | _ -> Hashtbl.clear hist_dirty;
-                end
-                |_ -> Hashtbl.clear hist_dirty;
- 
-		  last_device_call_loc <- l.line;	
-		);
+		let e1 = (call_name ex) in
+		if (isbad e1 no_names == 1) && (lv_option = None) then
+		  last_device_call_loc <- l.line;
 
                   match lv_option with
  		  | Some (lv) ->
@@ -2577,49 +4508,26 @@ class driverVisitor = object (self) (* self is equivalent to this in Java/C++ *)
            else ((mkEmptyStmt ()),false)
    end
  
-  method put_if_info_in_hash (e: exp) : unit = 
-  begin
-	let cont_str_list = self#find_lvals_exp e in
-        for k = 0 to (List.length cont_str_list) - 1 do
-          let cur_cont_str = (List.nth cont_str_list k) in
-          Hashtbl.add hist_dirty (cur_cont_str , curr_func.svar.vname) "yes";
-          (* Printf.fprintf stderr "added %s\n" cur_cont_str; *)
-        done;
-         Hashtbl.add hist_dirty ((exp_to_string e) , curr_func.svar.vname) "yes";
-  end 
 
-
-
-  (* Converts an instruction list to a statement list *)
+  (* Converts an instruction list to a statement list, accumulating in
+   * reverse like get_stmt_list_from_instr_list. *)
    method get_stmt_list_from_instr_list_deref (i_list: instr list) (labels: label list) : stmt list =
    begin
       let stmt_list = ref [] in
       let curr_instr_list = ref [] in
-        for i = 0 to (List.length i_list) - 1 do
-          begin
-            let (new_stmt,need_deref_check) = (self#get_deref_check_stmt (List.nth i_list i)) in
+        List.iter (fun i ->
+            let (new_stmt,need_deref_check) = (self#get_deref_check_stmt i) in
                 if(need_deref_check)
                 then begin
-                        let curr_stmt = mkStmt(Instr(!curr_instr_list)) in
-                          curr_stmt.skind <- Instr(!curr_instr_list);
-                          stmt_list := (List.append !stmt_list
-                                        (List.append [curr_stmt] [new_stmt]));
-                          mem_deref_bugs <- mem_deref_bugs + 1;
-			  error_line_nos := !error_line_nos@[(Printf.sprintf "Dynamic array:%d"last_instr_loc)];
-                          curr_instr_list := [(List.nth i_list i)];
+                        let curr_stmt = mkStmt(Instr(List.rev !curr_instr_list)) in
+                          stmt_list := new_stmt :: curr_stmt :: !stmt_list;
+			  self#add_deref_check new_stmt last_instr_loc
+			    (Pretty.sprint 100 (dn_instr () i));
+                          curr_instr_list := [i];
                 end
-                else curr_instr_list := (List.append !curr_instr_list [(List.nth i_list i)])
-          end;
-        done;
-        let final_stmt = mkStmt(Instr(!curr_instr_list)) in	(
-                final_stmt.skind <- Instr(!curr_instr_list);
-	match final_stmt.skind with
-	| If(e,b1,b2,l) ->
-		self#put_if_info_in_hash e; 
-	|_ -> ();
-
-	);
-        let final_stmt_list = List.append !stmt_list [final_stmt] in
+                else curr_instr_list := i :: !curr_instr_list) i_list;
+        let final_stmt = mkStmt(Instr(List.rev !curr_instr_list)) in
+        let final_stmt_list = List.rev (final_stmt :: !stmt_list) in
                 (List.hd final_stmt_list).labels <- labels;
                 final_stmt_list;
    end
@@ -2736,29 +4644,14 @@ class driverVisitor = object (self) (* self is equivalent to this in Java/C++ *)
            begin
               let deref_lvals = (self#find_deref_lval_list_from_exp e) in
                 let cont_deref_lvals = (self#find_cont_deref_lvals deref_lvals) in
-			let cont_str_list = self#find_lvals_exp e in
-			for k = 0 to (List.length cont_str_list) - 1 do
-			let cur_cont_str = (List.nth cont_str_list k) in
-				Hashtbl.add hist_dirty (cur_cont_str , curr_func.svar.vname) "yes";
-				Hashtbl.add hist_if_ptr_check (cur_cont_str , curr_func.svar.vname) l.line;
-			done;
-			Hashtbl.add hist_dirty ((exp_to_string e) , curr_func.svar.vname) "yes";
                         if(List.length cont_deref_lvals > 0) then
                         begin
-				(* Printf.fprintf stderr "Saw iffif.\n";
-				let cont_str_list = self#find_lvals_exp e in
-				  for k = 0 to (List.length cont_str_list) - 1 do
-				     let cur_cont_str = (List.nth cont_str_list k) in
-				      Hashtbl.add hist_dirty (cur_cont_str , curr_func.svar.vname) "yes";
-			              Printf.fprintf stderr "added %s .\n" cur_cont_str;
-				done;
-				     Hashtbl.add hist_dirty ((exp_to_string e) , curr_func.svar.vname) "yes";
-				 find_lvals_exp *)
                                 let new_if_stmt = (mkStmt (If(e,b1,b2,l))) in
                                         new_if_stmt.skind <- If(e,b1,b2,l);
-                                        mem_deref_bugs <- mem_deref_bugs + 1;
-					error_line_nos := !error_line_nos@[(Printf.sprintf "Dynamic array:%d"l.line)];
-                                        (self#get_stmt_from_if_stmt_deref cont_deref_lvals s.labels) :: [new_if_stmt];
+                                        let check = self#get_stmt_from_if_stmt_deref cont_deref_lvals s.labels in
+					self#add_deref_check check l.line
+					  (String.concat ", " (List.map lval_to_string cont_deref_lvals));
+                                        check :: [new_if_stmt];
                         end
                         else [s]
            end
@@ -2777,94 +4670,21 @@ class driverVisitor = object (self) (* self is equivalent to this in Java/C++ *)
 	new_stmt;
    end 
   
+   (* Whether a dereference of e may see a device value: e reads a variable
+    * tainted before this point. Whether the pointer was already checked on
+    * every path to the dereference is decided on the CFG once the function
+    * is rewritten (elim_redundant_checks). *)
    method process_dereference (e:exp) : int =
    begin
-	let unsafe_dref = ref 0 in
-	let found = ref 0 in
-        let str_list = ref [] in
-        str_list := self#find_lvals_exp e;
-	let incoming_exp = (exp_to_string e) in
-
-        (* Printf.fprintf stderr "DREF PROCESS FOR %s" incoming_exp;   *)
-	if (last_device_call_loc = 0) then    (
-		found := 1; );
-
-	if (last_instr_loc != 0) then (
-	 (* Printf.fprintf stderr "last instruction seen at %d.\n" last_instr_loc;
-	  Printf.fprintf stderr "last device call seen at %d.\n" last_device_call_loc; *)
-
-	  try 
-	    let ret_int = (Hashtbl.find hist_if_ptr_check (incoming_exp, curr_func.svar.vname)) in
-	    (* Printf.fprintf stderr "(Maybe already checked)last ret_from_hash seen at %d.\n" ret_int; *)
-	  if ((ret_int  > last_device_call_loc) & (last_instr_loc - ret_int < 10) & (last_instr_loc - ret_int > 0)) then
-	  (	(* Printf.fprintf stderr "(Checked indeed) last ret_from_hash seen at %d.\n" ret_int; *)
-		Hashtbl.add hist_dirty (incoming_exp, curr_func.svar.vname) "yes"; 
-		found := 1;
-	  );
-          if (last_device_call_loc = 0) then	(
-		found := 1; )
-	  with Not_found -> ();
-	 
-	  try
-	    let ret_int = (Hashtbl.find when_dirrrty (incoming_exp, curr_func.svar.vname)) in
-		if (ret_int > 0) && (ret_int > last_instr_loc) then	(
-		found := 1;
-		)
-	   with Not_found -> ();
- 
-	);
-
-	if (!found = 0) then (
-       
-	try (
-	let ret_str = (Hashtbl.find hist_dirty (incoming_exp ,curr_func.svar.vname)) in
-		
-		Printf.fprintf stderr ""; 
-		(* !unsafe_dref; *)
-	);
-	with Not_found -> (
-        (*
-        let var_li = ref [] in
-          var_li := (Ptranal.resolve_exp e);
-
-        Printf.fprintf stderr "Varinfo list is %d long.\n" (List.length !var_li);
-        for vlcnt = 0 to (List.length !var_li) - 1 do
-          let cur_var = (List.nth !var_li vlcnt) in
-                Printf.fprintf stderr "Suspect at %s" cur_var.vname;
-        done;
-        *)  (* checks each and every variable is dirty in the expression. *)
-
-	        for i = 0 to (List.length !str_list) - 1 do
-		    let cur_e = (List.nth !str_list i) in
-		(try ( 
-        	let ret_str = (Hashtbl.find dirrrty ((cur_e),curr_func.svar.vname)) in
-                	(* Printf.fprintf stderr "fn(%s) NOT SAFE DETECTED mapping ->  %s for %s.\n"
-                        	curr_func.svar.vname ret_str (exp_to_string e);i *)
-
-	        try
-       		     let ret_int = (Hashtbl.find hist_if_ptr_check (cur_e, curr_func.svar.vname)) in
-       		 	  if ((ret_int  > last_device_call_loc) & (last_instr_loc - ret_int < 10) & (last_instr_loc - ret_int > 0)) then
-	       		 (     
-        	        	Hashtbl.add hist_dirty (incoming_exp, curr_func.svar.vname) "yes";
-	        	  );
-		          if (last_device_call_loc = 0) then    (
-        		        found := 1; )
-	        	  with Not_found -> (
-
-			 Hashtbl.add hist_dirty
-        	                          (incoming_exp , curr_func.svar.vname) "yes";
-
-			unsafe_dref := 1;
-			);
-			
-        	);
-	        with Not_found -> ();
-		);
-		done;
-	);
-	);
-		
-	!unsafe_dref
+	let tainted_here (v: varinfo) : bool =
+	  let key = var_tkey v curr_func in
+	  (Hashtbl.mem dirrrty key)
+	  && (try let line = Hashtbl.find when_dirrrty key in
+	          not ((line > 0) && (last_instr_loc != 0) && (line > last_instr_loc))
+	      with Not_found -> true)
+	in
+	if (last_device_call_loc != 0)
+	   && (List.exists tainted_here (self#find_vars_exp e)) then 1 else 0
    end
  
    method find_deref_in_exp (e : exp) : unit =
@@ -2957,19 +4777,18 @@ class driverVisitor = object (self) (* self is equivalent to this in Java/C++ *)
       block_count := !block_count + 1;
       done_gen := 0;
       done_ret_gen := 0;
-      locate_ret_call_count <- 0;
-      (* The stmt_list to replace the current statement *)
-      let stmt_list = ref [] in 
-        for i = 0 to (List.length b.bstmts) - 1 do
-		stmt_list := !stmt_list @ (self#get_stmt_list (List.nth b.bstmts i));
-	    done;
-        b.bstmts <- !stmt_list;	      
-
-      let deref_stmt_list = ref [] in	
-       for i = 0 to (List.length b.bstmts) - 1 do
-	 deref_stmt_list := !deref_stmt_list @ (self#get_stmt_list_deref (List.nth b.bstmts i));
-       done;	   
-      b.bstmts <- !deref_stmt_list;
+      (* Rewrite the statements in one pass: the bounds checks of a statement,
+       * then the deref checks of each statement that gives. Only the bounds
+       * rewrite keeps state (hist_array_dirty), so this is the same as
+       * rewriting the whole block for one and then the other.
+       * The new statements are accumulated in reverse. *)
+      let rewrite (bstmts: stmt list) : stmt list =
+        List.fold_left (fun acc s ->
+          List.fold_left (fun acc s' ->
+              List.rev_append (self#get_stmt_list_deref s') acc)
+            acc (self#get_stmt_list s))
+        [] bstmts in
+      b.bstmts <- List.rev (Stats.time "carb-rewrite" rewrite b.bstmts);
 
       DoChildren;
       (* ChangeDoChildrenPost (curr_block, (fun b -> curr_block)); *)
@@ -2978,10 +4797,17 @@ class driverVisitor = object (self) (* self is equivalent to this in Java/C++ *)
    (* Visits every function *)
    method vfunc (f: fundec) : fundec visitAction =
    begin
+     (* When streaming, the taint of f was dropped after compute_taint *)
+     if streaming () then begin
+       clear_function_tables ();
+       ignore (taint_function f)
+     end;
      (* Build CFG for every function.*) 
-     (Cil.prepareCFG f);
+     (ensure_cfg f);
      (Cil.computeCFGInfo f false);  (* false = per-function stmt numbering,
                                              true = global stmt numbering *)
+     summarize_reports f;
+     nat_loops <- natural_loops f;
 
      curr_func <- f; (*Store the value of current func before getting into
                        deeper visitor analysis. *)
@@ -2991,36 +4817,218 @@ class driverVisitor = object (self) (* self is equivalent to this in Java/C++ *)
      block_count := 0;
      last_device_call_loc <- 0;
      last_array_device_call_loc <- 0;	
-
-     DoChildren;
+     Hashtbl.clear ret_search_memo;
+     added_checks <- [];
+     deref_checks <- [];
+     bounds_checks <- [];
+
+     match (if !cache_dir = "" then None else summary_path f) with
+     | None ->
+         Stats.time "carb-mmio" self#check_mmio_reads f;
+         Stats.time "carb-dma-lifecycle" self#check_dma_lifecycle f;
+         Stats.time "carb-polling" self#check_goto_loops ();
+         ChangeDoChildrenPost (f, (fun f -> self#elim_checks f; f));
+     | Some path ->
+        (match load_summary path with
+         | Some summary ->
+             (* The ticks are counted by per_fun *)
+             self#add_counts { summary.fs_counts with fc_ticks = 0 };
+             List.iter (fun fi ->
+                 add_finding
+                   (if fi.fi_line < 0 then fi
+                   else { fi with fi_line = fi.fi_line + f.svar.vdecl.line }))
+               summary.fs_findings;
+             List.iter (fun init ->
+                 per_fun <- f :: per_fun;
+                 per_fun_ctr <- init :: per_fun_ctr)
+               (relink_body f summary.fs_body);
+             SkipChildren;
+         | None ->
+             fun_start_counts <- Some (self#finding_counts ());
+             fun_start_findings <- !num_findings;
+             Stats.time "carb-mmio" self#check_mmio_reads f;
+             Stats.time "carb-dma-lifecycle" self#check_dma_lifecycle f;
+             Stats.time "carb-polling" self#check_goto_loops ();
+             ChangeDoChildrenPost (f, (fun f ->
+               self#elim_checks f; self#save_summary path f; f)));
    end
+
+   (* Report the register reads of f that repeat an earlier read *)
+   method check_mmio_reads (f: fundec) : unit =
+     List.iter (fun (line, key, first) ->
+         mmio_reads <- mmio_reads + 1;
+         self#report_cost "redundant_mmio_read" line
+           (Printf.sprintf "%s, read at line %d (~%d ns)" key first !mmio_cost_ns)
+           "none" (!mmio_cost_ns / 1000))
+       (redundant_mmio_reads f nat_loops)
+
+   (* Report the redundant DMA syncs of f and the maps of its loops that
+    * could be persistent *)
+   method check_dma_lifecycle (f: fundec) : unit =
+     List.iter (fun (line, why) ->
+         dma_syncs <- dma_syncs + 1;
+         self#report "redundant_dma_sync" line why "none")
+       (redundant_dma_syncs f);
+     List.iter (fun (line, key) ->
+         dma_loop_maps <- dma_loop_maps + 1;
+         self#report "dma_map_in_loop" line
+           (key ^ " mapped and unmapped in a loop") "none")
+       (dma_maps_in_loops nat_loops)
+
+   (* A null check of a tainted pointer. It is reported once it is known to
+    * be needed. *)
+   method add_deref_check (check: stmt) (line: int) (source: string) : unit =
+     added_checks <- check :: added_checks;
+     deref_checks <- (check, line, source) :: deref_checks
+
+   (* A bounds check of a tainted index, reported the same way *)
+   method add_bounds_check (check: stmt) (line: int) (source: string) : unit =
+     added_checks <- check :: added_checks;
+     bounds_checks <- (check, line, source) :: bounds_checks
+
+   (* Remove the redundant checks added to f, then report the bounds and
+    * null checks that are left *)
+   method elim_checks (f: fundec) : unit =
+     let dropped =
+       if !check_elim && added_checks <> [] then begin
+         let (dropped, hoisted) =
+           Stats.time "carb-elim" (elim_redundant_checks f) added_checks in
+         checks_dropped <- checks_dropped + List.length dropped;
+         checks_hoisted <- checks_hoisted + hoisted;
+         dropped
+       end else []
+     in
+     List.iter (fun (check, line, source) ->
+         if not (List.memq check dropped) then begin
+           num_array_checks_added <- num_array_checks_added + 1;
+           self#report "static_array" line source "bounds_check"
+         end)
+       (List.rev bounds_checks);
+     List.iter (fun (check, line, source) ->
+         if not (List.memq check dropped) then begin
+           mem_deref_bugs <- mem_deref_bugs + 1;
+           self#report "dynamic_array" line source "null_check"
+         end)
+       (List.rev deref_checks);
+     added_checks <- [];
+     deref_checks <- [];
+     bounds_checks <- []
+
+   (* Record a finding in the current function *)
+   method report (category: string) (line: int) (source: string) (fix: string) : unit =
+     self#report_cost category line source fix 0
+
+   (* Record a finding in the current function that costs cost_us of CPU
+    * time *)
+   method report_cost (category: string) (line: int) (source: string)
+       (fix: string) (cost_us: int) : unit =
+     add_finding { fi_category = category;
+                   fi_file = curr_func.svar.vdecl.file;
+                   fi_function = curr_func.svar.vname;
+                   fi_line = line;
+                   fi_source = source;
+                   fi_fix = fix;
+                   fi_cost_us = cost_us;
+                 }
+
+   (* The bug counters so far *)
+   method finding_counts () : finding_counts =
+     { fc_ticks = List.length per_fun - 1 + merged_ticks;
+       fc_array_checks = num_array_checks_added;
+       fc_deref_bugs = mem_deref_bugs;
+       fc_bad_ptr_lvals = num_bad_ptr_lvals;
+       fc_ret_on_error = return_on_device_error;
+       fc_ret_pk = ret_pk_count;
+       fc_report_timeout = report_timeout_counter;
+       fc_dma_taint = !dma_taint;
+       fc_checks_dropped = checks_dropped;
+       fc_checks_hoisted = checks_hoisted;
+       fc_mmio_reads = mmio_reads;
+       fc_busy_waits = busy_waits;
+       fc_dma_syncs = dma_syncs;
+       fc_dma_loop_maps = dma_loop_maps;
+     }
+
+   (* Account for the findings of a cached or worker-analyzed function *)
+   method add_counts (c: finding_counts) : unit =
+     merged_ticks <- merged_ticks + c.fc_ticks;
+     num_array_checks_added <- num_array_checks_added + c.fc_array_checks;
+     mem_deref_bugs <- mem_deref_bugs + c.fc_deref_bugs;
+     num_bad_ptr_lvals <- num_bad_ptr_lvals + c.fc_bad_ptr_lvals;
+     return_on_device_error <- return_on_device_error + c.fc_ret_on_error;
+     ret_pk_count <- ret_pk_count + c.fc_ret_pk;
+     report_timeout_counter <- report_timeout_counter + c.fc_report_timeout;
+     dma_taint := !dma_taint + c.fc_dma_taint;
+     checks_dropped <- checks_dropped + c.fc_checks_dropped;
+     checks_hoisted <- checks_hoisted + c.fc_checks_hoisted;
+     mmio_reads <- mmio_reads + c.fc_mmio_reads;
+     busy_waits <- busy_waits + c.fc_busy_waits;
+     dma_syncs <- dma_syncs + c.fc_dma_syncs;
+     dma_loop_maps <- dma_loop_maps + c.fc_dma_loop_maps
+
+   (* Summarize the function just analyzed into the cache *)
+   method save_summary (path: string) (f: fundec) : unit =
+     match fun_start_counts with
+     | None -> ()
+     | Some start ->
+        let inits = ref [] in
+        List.iter2 (fun funn stmt_init_var ->
+            if funn == f then inits := stmt_init_var :: !inits)
+          per_fun per_fun_ctr;
+        store_summary path
+          { fs_body = { cb_line = f.svar.vdecl.line;
+                        cb_formals = f.sformals;
+                        cb_locals = f.slocals;
+                        cb_body = f.sbody;
+                        cb_maxid = f.smaxid;
+                        cb_tick_inits = !inits;
+                      };
+            fs_counts = diff_counts (self#finding_counts ()) start;
+            fs_findings =
+              List.map (fun fi ->
+                  if fi.fi_line < 0 then fi
+                  else { fi with fi_line = fi.fi_line - f.svar.vdecl.line })
+                (findings_since fun_start_findings);
+          };
+        fun_start_counts <- None
     
     method top_level (f:file) :unit =
       begin
 
-         (* Do some points-to analysis  No idea wat this does*)
-          Ptranal.no_sub := false;
-          Ptranal.analyze_mono := true;
-          Ptranal.smart_aliases := false;
-          Ptranal.analyze_file f; (* Performs actual points-to analysis *)
-          Ptranal.compute_results false; (* Just prints the  points-to-graph to screen *)
-        
-
         (* Start the visiting *)
-        visitCilFileSameGlobals (self :> cilVisitor) f; 
-
+        open_stream ();
+        if (!carb_jobs > 1) then
+          self#visit_parallel f !carb_jobs
+        else
+          visitCilFileSameGlobals (self :> cilVisitor) f; 
+
+        Stats.time "carb-report" self#print_report ();
+        if streaming () then close_stream f
+        else self#insert_tick_inits ();
+        self#set_counters ();
+    end 
 
-	if (List.length per_fun -1 + num_array_checks_added + 
+   (* Print the summary of the findings and write them out *)
+   method print_report () : unit =
+   begin
+	if ((self#finding_counts ()).fc_ticks + num_array_checks_added + 
 		mem_deref_bugs + !halt_count + return_on_device_error + report_timeout_counter + num_bad_ptr_lvals) > 0 then (
 		
 		Printf.fprintf stderr "\n====================Hardware dependence bugs======================\n";
 
-        Printf.fprintf stderr "\n Infinite polling: %d.\n" (List.length
-        per_fun - 1);
-        Printf.printf "ticks %d " (List.length per_fun
-        - 1);
+        Printf.fprintf stderr "\n Infinite polling: %d.\n" (self#finding_counts ()).fc_ticks;
+        Printf.printf "ticks %d " (self#finding_counts ()).fc_ticks;
         Printf.fprintf stderr " Unsafe static array deference: %d\n" num_array_checks_added;
         Printf.printf "newstmt %d" num_array_checks_added;
+        if (checks_dropped + checks_hoisted > 0) then
+          Printf.fprintf stderr " Redundant checks removed: %d, hoisted out of loops: %d\n"
+            checks_dropped checks_hoisted;
+        if (dma_syncs + dma_loop_maps > 0) then
+          Printf.fprintf stderr " Redundant DMA syncs: %d, DMA maps in loops: %d\n"
+            dma_syncs dma_loop_maps;
+        if (mmio_reads > 0) then
+          Printf.fprintf stderr " Redundant device reads: %d (~%d us)\n"
+            mmio_reads (mmio_reads * !mmio_cost_ns / 1000);
 	
 	Printf.printf " mem bugs %d hlt %d ret %d rtc %d pk %d dma %d." mem_deref_bugs !halt_count return_on_device_error report_timeout_counter ret_pk_count !dma_taint; (*num_bad_ptr_lvals; pk_in_rtc *)
 	Printf.fprintf stderr " Dynamic array deference: %d\n Unsafe halt code:  %d\n Missing error report on device failure: %d\n Missing error report on device timeout: %d\n Existing device failures reported: %d\n Other(ignore)dma %d.\n" mem_deref_bugs !halt_count return_on_device_error report_timeout_counter ret_pk_count !dma_taint; (* num_bad_ptr_lvals; pk_in_rtc *)
@@ -3030,11 +5038,9 @@ class driverVisitor = object (self) (* self is equivalent to this in Java/C++ *)
  
 	if (gen_line_nos = 1 ) then (	
 	Printf.fprintf stderr "\n====================Detailed Summary(with line numbers)=================\n";
-	for ctr = 0 to (List.length !error_line_nos) - 1 do
-	  let cur_err_no = (List.nth !error_line_nos ctr) in
-	Printf.fprintf stderr " %s \n" cur_err_no;
-	(*Printf.printf "%s " cur_err_no; *)
-	done;	
+	List.iter (fun fi ->
+	  Printf.fprintf stderr " %s:%d %s (%s)\n" fi.fi_file fi.fi_line fi.fi_category
+	    fi.fi_function) (List.rev !findings);
 	Printf.fprintf stderr "\n\nNote: When CIL cannot compute line numbers: Line numbers show up as -1.\n\n";
 	
 	);
@@ -3048,6 +5054,84 @@ class driverVisitor = object (self) (* self is equivalent to this in Java/C++ *)
 
 		
 
+        if busy_waits > 0 then begin
+          Printf.fprintf stderr "====================Busy waits by worst-case CPU time====================\n";
+          List.iter (fun fi ->
+              Printf.fprintf stderr " %s:%d %s (%s)\n" fi.fi_file fi.fi_line
+                fi.fi_source fi.fi_function)
+            (List.stable_sort (fun a b -> compare b.fi_cost_us a.fi_cost_us)
+               (List.filter (fun fi -> fi.fi_category = "busy_wait")
+                  (List.rev !findings)));
+          Printf.fprintf stderr "\n"
+        end;
+
+        if !datapath_allocs + !datapath_maps > 0 then
+          Printf.fprintf stderr " Datapath allocations: %d, DMA mappings: %d\n\n"
+            !datapath_allocs !datapath_maps;
+
+        if !isr_profiles <> [] then begin
+          Printf.fprintf stderr "====================Interrupt handlers by estimated latency====================\n";
+          List.iter (fun p ->
+              Printf.fprintf stderr " %s (%s:%d) %s\n" p.ip_handler.svar.vname
+                p.ip_handler.svar.vdecl.file p.ip_handler.svar.vdecl.line
+                (isr_summary p))
+            !isr_profiles;
+          Printf.fprintf stderr "\n"
+        end;
+
+        write_findings (List.rev !findings);
+   end
+
+   (* The sizes of the taint tables and the checks inserted, for --stats *)
+   method set_counters () : unit =
+   begin
+     let c = self#finding_counts () in
+     Stats.set_count "carb tainted vars (dirrrty)" (Hashtbl.length dirrrty);
+     Stats.set_count "carb taint lines (when_dirrrty)" (Hashtbl.length when_dirrrty);
+     Stats.set_count "carb contaminated exps" (Hashtbl.length contaminated);
+     Stats.set_count "carb tainted returns" (Hashtbl.length funcs_with_cont_return);
+     Stats.set_count "carb tainted stores" (Hashtbl.length stored_taint);
+     Stats.set_count "carb ticks inserted" c.fc_ticks;
+     Stats.set_count "carb bounds checks inserted" c.fc_array_checks;
+     Stats.set_count "carb null checks inserted" c.fc_deref_bugs;
+     Stats.set_count "carb checks removed" c.fc_checks_dropped;
+     Stats.set_count "carb checks hoisted" c.fc_checks_hoisted;
+     Stats.set_count "carb redundant device reads" c.fc_mmio_reads;
+     Stats.set_count "carb busy waits" c.fc_busy_waits;
+     Stats.set_count "carb redundant dma syncs" c.fc_dma_syncs;
+     Stats.set_count "carb dma maps in loops" c.fc_dma_loop_maps;
+     Stats.set_count "carb datapath allocations" !datapath_allocs;
+     Stats.set_count "carb datapath dma mappings" !datapath_maps;
+     Stats.set_count "carb interrupt handlers profiled" (List.length !isr_profiles);
+   end
+
+   (* With --carb-stream, print each global once checked. A function gets its
+    * tick counters first and loses its body after. *)
+   method vglob (g: global) : global list visitAction =
+     if not (streaming ()) then DoChildren
+     else
+       ChangeDoChildrenPost ([g], (fun gl ->
+         List.iter (fun g ->
+             match g with
+             | GFun(fd, _) ->
+                 self#insert_tick_inits_of fd;
+                 print_streamed g;
+                 drop_body fd
+             | _ -> print_streamed g)
+           gl;
+         gl))
+
+   (* The tick counter initializations of one function *)
+   method insert_tick_inits_of (fd: fundec) : unit =
+     List.iter2 (fun funn stmt_init_var ->
+         if funn == fd then
+           fd.sbody.bstmts <- stmt_init_var :: fd.sbody.bstmts)
+       per_fun per_fun_ctr
+
+   (* Put the initialization of the tick counters at the start of the
+    * functions that got ticks code. *)
+   method insert_tick_inits () : unit =
+   begin
         for count = 0 to (List.length per_fun) - 1 do
             let funn = (List.nth per_fun count) in
             let stmt_init_var = (List.nth per_fun_ctr count) in
@@ -3055,9 +5139,75 @@ class driverVisitor = object (self) (* self is equivalent to this in Java/C++ *)
             funn.svar.vname; *)
                 funn.sbody.bstmts <- stmt_init_var :: funn.sbody.bstmts;
             done;
+   end
 
+   (* Runs the checks of one worker over its functions. *)
+   method worker_results (bucket: (int * fundec) list) : worker_result list =
+   begin
+     let results = List.map (fun (i, fd) ->
+         let start = self#finding_counts () in
+         let nfind = !num_findings in
+         ignore (visitCilFunction (self :> cilVisitor) fd);
+         (i, fd, diff_counts (self#finding_counts ()) start,
+          findings_since nfind)) bucket in
+     self#insert_tick_inits ();
+     results;
+   end
 
-    end 
+   (* Visit the functions of the file in forked workers, then merge the
+    * rewritten functions and the findings back in file order. *)
+   method visit_parallel (f: file) (jobs: int) : unit =
+   begin
+     let globals = Hashtbl.create 127 in
+     let funcs = ref [] in
+     let count = ref 0 in
+     iterGlobals f (fun g ->
+       match g with
+       | GFun(fd, _) ->
+           Hashtbl.replace globals fd.svar.vid fd.svar;
+           funcs := (!count, fd) :: !funcs;
+           incr count;
+       | GVar(vi, _, _) | GVarDecl(vi, _) -> Hashtbl.replace globals vi.vid vi;
+       | _ -> ());
+     let fds = Array.of_list (List.rev_map snd !funcs) in
+     let buckets = Array.make jobs [] in
+     (* Round robin, so large functions at one end of the file are spread. *)
+     List.iter (fun (i, fd) ->
+         buckets.(i mod jobs) <- (i, fd) :: buckets.(i mod jobs)) !funcs;
+     let fork_vid = newVID () in
+     flush stdout;
+     flush stderr;
+     let workers = List.map (fun bucket ->
+       let (rd, wr) = Unix.pipe () in
+       match Unix.fork () with
+       | 0 ->
+           Unix.close rd;
+           let oc = Unix.out_channel_of_descr wr in
+           (try
+             output_value oc (self#worker_results bucket);
+             close_out oc;
+             exit 0
+           with e ->
+             Printf.fprintf stderr "carburizer worker: %s\n" (Printexc.to_string e);
+             exit 1)
+       | pid ->
+           Unix.close wr;
+           (pid, Unix.in_channel_of_descr rd)) (Array.to_list buckets) in
+     let results = List.concat (List.map (fun (pid, ic) ->
+       let (res: worker_result list) =
+         try input_value ic
+         with End_of_file | Failure _ -> [] in
+       close_in ic;
+       (match Unix.waitpid [] pid with
+        | (_, Unix.WEXITED 0) -> ()
+        | _ -> Errormsg.s (Errormsg.error "Carburizer worker %d failed" pid));
+       res) workers) in
+     List.iter (fun (i, w, counts, found) ->
+         merge_worker_fundec globals fork_vid fds.(i) w;
+         self#add_counts counts;
+         List.iter add_finding found)
+       (List.sort (fun (i, _, _, _) (j, _, _, _) -> compare i j) results);
+   end
 end    
     
 
@@ -3100,16 +5250,50 @@ end
    end
 
 
+(* Forget the tables of the previous file, for a process that analyzes
+ * several (cilly --server) *)
+let reset_file_state () : unit =
+  add_pk := 1;
+  halt_count := 0;
+  dma_taint := 0;
+  Hashtbl.clear dirrrty;
+  Hashtbl.clear when_dirrrty;
+  Hashtbl.clear contaminated;
+  Hashtbl.clear hist_array_dirty;
+  Hashtbl.clear ptr_seen_before;
+  Hashtbl.clear hist_infinite_dirty;
+  Hashtbl.clear funcs_with_cont_return;
+  Hashtbl.clear locateexplist;
+  Hashtbl.clear stored_taint;
+  Hashtbl.clear formal_taint;
+  new_formal_taints := [];
+  Hashtbl.clear body_digests;
+  Hashtbl.clear cache_globals;
+  Hashtbl.clear cache_comps;
+  Hashtbl.clear cache_typedefs;
+  Hashtbl.clear cache_enums;
+  Hashtbl.clear cfg_ready;
+  Hashtbl.clear stmt_reports;
+  Hashtbl.clear stmt_parent;
+  findings := [];
+  num_findings := 0;
+  bench_phases := [];
+  isr_profiles := [];
+  Hashtbl.clear isr_context;
+  datapath_allocs := 0;
+  datapath_maps := 0;
+  alias_file := None;
+  alias_ready := false;
+  guard_globals := None
+
 (*Toplevel function for our Beefy Analysis *)
 let dobeefyanalysis (f:file)  : unit = 	
   begin
+   reset_file_state ();
       (* Printf.printf "#### Execution time: %f\n" (Sys.time()));
       (Printf.printf "### Asim is Asim\n"); *) 
 
-   for i = 0 to (List.length f.globals) - 1 do
-          let curr_g = (List.nth f.globals i) in
-          initial_filter curr_g;
-	done;
+   carb_phase "carb-filter" (List.iter initial_filter) f.globals;
 
 	if (!add_pk == 1) then 	(
 	let pk_kern_fundec = (get_pk_kern_fundec()) in
@@ -3122,11 +5306,18 @@ let dobeefyanalysis (f:file)  : unit =
       intr_correct := 0;
       intr_found := 0;
       
+      carb_phase "carb-taint" compute_taint f;
+      carb_phase "carb-isr" profile_isrs f;
+      carb_phase "carb-datapath" check_datapath f;
+      declare_guard_globals f;
+      if !cache_dir <> "" || !carb_jobs > 1 then index_cache_globals f;
+
       let initVisitor : initialVisitor = new initialVisitor in
-      initVisitor#top_level f;
+      carb_phase "carb-init" initVisitor#top_level f;
       
       let driVisitor : driverVisitor = new driverVisitor in
-      driVisitor#top_level f;
+      carb_phase "carb-checks" driVisitor#top_level f;
+      print_bench_phases ();
     
   end
 
@@ -3135,7 +5326,36 @@ let feature : featureDescr =
   { fd_name = "drivers";              
     fd_enabled = ref false;
     fd_description = "Device Driver Analysis";
-    fd_extraopt = [];
+    fd_extraopt = [
+      ("--carb-sigs", Arg.String Devsigs.load_file,
+       "<file> Load extra device API signatures (sources, sinks, halting,\n\t\t\t\tDMA and report calls) from a file");
+      ("--carb-jobs", Arg.Int (fun n -> carb_jobs := n),
+       "<n> Run the per-function checks in n worker processes");
+      ("--carb-findings", Arg.String (fun s -> findings_file := s),
+       "<file> Append the findings to a file as JSON Lines, one object per\n\t\t\t\tfinding (category, file, function, line, source, fix, cost_us)");
+      ("--carb-cache", Arg.String set_cache_dir,
+       "<dir> Keep per-function summaries in a directory and skip the checks\n\t\t\t\tof unchanged functions (their checked bodies are reused)");
+      ("--carb-alias", Arg.String set_alias_tier,
+       "<none|unify|golf> Follow device values through pointer stores with\n\t\t\t\tthe unification (unify) or subtyping (golf) mode of\n\t\t\t\tPtranal (default none). Not with --server");
+      ("--carb-bench", Arg.Set bench_output,
+       " Print the wall time and allocation of each analysis phase");
+      ("--carb-stream", Arg.String (fun s -> stream_file := s),
+       "<file> Write the checked program to a file function by function,\n\t\t\t\tkeeping only the function being checked in memory");
+      ("--carb-stats-json", Arg.String set_stats_json,
+       "<file> Write the timings and counters of the analysis (see --stats)\n\t\t\t\tto a file as JSON");
+      ("--carb-keep-checks", Arg.Clear check_elim,
+       " Keep the bounds checks implied by an earlier check or condition");
+      ("--carb-mmio-cost", Arg.String (fun s -> mmio_cost_ns := positive "cost" s),
+       "<ns> Estimated cost of one device register read, in the findings of\n\t\t\t\tredundant reads (default 1000)");
+      ("--carb-guard", Arg.String set_guard_mode,
+       "<count|time> Guard polling loops with an iteration count (default)\n\t\t\t\tor a time budget checked every few iterations");
+      ("--carb-guard-interval", Arg.String (fun s -> guard_interval := positive "interval" s),
+       "<n> Iterations between two checks of a time guard (default 64)");
+      ("--carb-guard-budget", Arg.String (fun s -> guard_budget_ms := positive "budget" s),
+       "<ms> Time budget of a polling loop (default 1000)");
+      ("--carb-guard-loop", Arg.String add_guard_override,
+       "<func:line:n:ms> Interval and budget of the time guard of the loop\n\t\t\t\tat line in func");
+    ];
     fd_doit = dobeefyanalysis;
     fd_post_check = true      (*What does this do?? *) 
   } 
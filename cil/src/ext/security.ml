@@ -51,24 +51,8 @@ let bufovflow_fns: string list =
 (*    "memcpy_fromio"; *)
   ];; 
 
-(* FIXME livelocks *)
-let livelck_fns: string list =
-  [ "sleep";
-    "msleep";
-    "usleep";
-    "ssleep";
-    "rdtscl";
-    "time_before";
-    "ndelay";
-    "udelay";
-    "mdelay";
-    "schedule_timeout";
-    "wait_event_noninterruptible_timeout";
-    "wait_event_interruptible_timeout";
-    "wait_event_timeout";
-  ];;  
-(* Above functions are apart from the stuck
- * control loops.
+(* FIXME livelocks. The delay and wait functions are in the livelock
+ * category of Devsigs, apart from the stuck control loops.
  *)
 
 (* Priority inversion
@@ -82,13 +66,7 @@ let usb_ip_fns: string list =
   ];;
 
 
-(* System wear out *)
-let wearout_fns: string list =
-    [  "kmalloc";
-       "kzalloc";
-       "kmem_cache_alloc";
-       "vfs_write";
-    ];;	
+(* System wear out: the wearout category of Devsigs *)
 
 
 (* Used to check for dirtyness that may impede liveness.i
@@ -344,14 +322,10 @@ let offset_to_string (o: offset) : string =
     begin
        (* Printf.fprintf stderr "Checking isinsecure:%s.\n" str; *)
       let rc = ref 0 in
-         for i = 0 to (List.length wearout_fns) - 1 do
-          let wearout_string = (List.nth wearout_fns i) in
-            if
-              (String.compare wearout_string str = 0) then (
-            rc := 1;
-	    lst_sec_cause := 1
-	    );
-        done;
+      if Devsigs.is_wearout str then (
+        rc := 1;
+        lst_sec_cause := 1
+      );
      
       let rc2 = ref 0 in
                for i = 0 to (List.length fmtstng_fns) - 1 do
@@ -374,14 +348,10 @@ let offset_to_string (o: offset) : string =
         done;
   
       let rc4 = ref 0 in
-               for i = 0 to (List.length livelck_fns) - 1 do
-          let ll_string = (List.nth livelck_fns i) in
-            if
-              (String.compare ll_string str = 0) then	(
-            rc4 := 1;
-	    lst_sec_cause := 4;
-	    );
-        done;
+      if Devsigs.is_livelock str then (
+        rc4 := 1;
+        lst_sec_cause := 4;
+      );
 
       let rc5 = ref 0 in 
 	for i = 0 to (List.length sl) - 1 do
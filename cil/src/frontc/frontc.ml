@@ -263,4 +263,36 @@ let parse_helper fname =
 
 let parse fname = (fun () -> snd(parse_helper fname ()))
 
+let parse_string_to_cabs (fname: string) (typedefs: string list) 
+                         (text: string) : Cabs.definition list =
+  try
+    let lexbuf = Clexer.initFromString ~filename:fname text in
+    List.iter Clexer.add_type typedefs;
+    let cabs = Stats.time "parse" (Cparser.interpret (Whitetrack.wraplexer clexer)) lexbuf in
+    Whitetrack.setFinalWhite (Clexer.get_white ());
+    Clexer.finish ();
+    if !E.hadErrors then 
+      raise (ParseError("There were parsing errors in " ^ fname));
+    cabs
+  with 
+    Parsing.Parse_error -> begin
+      Clexer.finish ();
+      raise (ParseError("Parse error in " ^ fname))
+    end
+  | ParseError _ as e -> raise e
+  | e -> begin
+      Clexer.finish ();
+      raise e
+    end
+
+let rec typedef_names (defs: Cabs.definition list) : string list =
+  List.fold_right
+    (fun d acc -> 
+      match d with
+        Cabs.TYPEDEF ((_, names), _) -> 
+          List.fold_right (fun (n, _, _, _) acc -> n :: acc) names acc
+      | Cabs.LINKAGE (_, _, defs') -> typedef_names defs' @ acc
+      | _ -> acc)
+    defs []
+
 let parse_with_cabs fname = (fun () -> parse_helper fname ())
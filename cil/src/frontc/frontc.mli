@@ -54,3 +54,11 @@ val args: (string * Arg.spec * string) list
 val parse: string -> (unit -> Cil.file)
 
 val parse_with_cabs: string -> (unit -> Cabs.file * Cil.file)
+
+    (* Parse C source held in a string (e.g. a part of a preprocessed file)
+     * to CABS, with the given names already known as typedefs. The first 
+     * argument names the source until its first line marker. *)
+val parse_string_to_cabs: string -> string list -> string -> Cabs.definition list
+
+    (* The names of the typedefs declared at the top level of definitions *)
+val typedef_names: Cabs.definition list -> string list
@@ -54,11 +54,8 @@ let outChannel : outfile option ref = ref None
 let mergedChannel : outfile option ref = ref None
 
 
-let parseOneFile (fname: string) : C.file =
-  (* PARSE and convert to CIL *)
-  if !Cilutil.printStages then ignore (E.log "Parsing %s\n" fname);
-  let cil = F.parse fname () in
-  
+(* The cleanup after parsing a file to CIL *)
+let finishParse (cil: C.file) : C.file =
   if (not !Epicenter.doEpicenter) then (
     (* sm: remove unused temps to cut down on gcc warnings  *)
     (* (Stats.time "usedVar" Rmtmps.removeUnusedTemps cil);  *)
@@ -67,6 +64,11 @@ let parseOneFile (fname: string) : C.file =
   );
   cil
 
+let parseOneFile (fname: string) : C.file =
+  (* PARSE and convert to CIL *)
+  if !Cilutil.printStages then ignore (E.log "Parsing %s\n" fname);
+  finishParse (Cilcache.parse (fun fname -> F.parse fname ()) fname)
+
 (** These are the statically-configured features. To these we append the 
   * features defined in Feature_config.ml (from Makefile) *)
   
@@ -153,6 +155,239 @@ let rec processOneFile (cil: C.file) =
       E.s (E.error "Error while processing file; see above for details.");
 
   end
+
+(***** SERVER *****)
+(* With --server SOCKET, cilly stays up and processes the files sent to a
+ * Unix socket, with the features and options of its command line. The
+ * start-up and the parsing of the headers that the files share are then
+ * paid once. A request is one connection, one item per line, then an empty
+ * line:
+ *
+ *   file PATH       a preprocessed source (several are merged)
+ *   out PATH        where to write the resulting C (optional)
+ *   findings PATH   where to append the findings of --dodrivers (optional)
+ *   quit            stop the server
+ *
+ * The reply is one line, "ok" or "error MESSAGE". See scripts/carb_client.pl.
+ *)
+let serverSocket = ref ""
+
+(* The top-level includes at the start of the files sent (headerChunks),
+ * parsed to CABS with the typedef names of all the includes up to them, by
+ * digest of their text and of the includes before them. The last used come
+ * first. *)
+let headerCache : (Digest.t * (Cabs.definition list * string list)) list ref = 
+  ref []
+let headerCacheSize = 256
+
+let lineMarker = 
+  Str.regexp "#[ \t]*\\(line[ \t]+\\)?\\([0-9]+\\)[ \t]+\"\\([^\"]*\\)\""
+
+(* Split a preprocessed file after the headers included at its start, that 
+ * is before the first line of the main file that is neither blank nor a line
+ * marker. Returns the name of the main file, the headers and the rest. The
+ * rest gets a line marker, so its locations do not change. None if the file
+ * does not start with includes. *)
+let splitHeaders (text: string) : (string * string * string) option = 
+  let len = String.length text in
+  let rec blank (i: int) (eol: int) = 
+    i >= eol || 
+    ((text.[i] = ' ' || text.[i] = '\t' || text.[i] = '\r') && blank (i + 1) eol)
+  in
+  (* main is the file of the first marker, cur the file of the line at pos *)
+  let rec scan pos main cur line included = 
+    if pos >= len then None else
+    let eol = try String.index_from text pos '\n' with Not_found -> len in
+    if Str.string_match lineMarker text pos then begin
+      let l = int_of_string (Str.matched_group 2 text) in
+      let f = Str.matched_group 3 text in
+      let main = if main = "" then f else main in
+      scan (eol + 1) main f l 
+        (included || (f <> main && f <> "" && f.[0] <> '<'))
+    end else if main <> "" && cur = main && not (blank pos eol) then begin
+      if not included then None else
+      Some (main, String.sub text 0 pos,
+            Printf.sprintf "# %d \"%s\"\n%s" line main 
+              (String.sub text pos (len - pos)))
+    end else
+      scan (eol + 1) main cur (line + 1) included
+  in
+  scan 0 "" "" 1 false
+
+(* The top-level includes of the headers of a file: the lines between two
+ * line markers of the main file. Those markers and the lines of the main
+ * file (blank there) are left out, since they name the file and the lines of
+ * its #includes, and no two files would share a chunk. *)
+let headerChunks (main: string) (headers: string) : string list = 
+  let chunks = ref [] in
+  let cur = Buffer.create 4096 in
+  let flush () = 
+    if Buffer.length cur > 0 then begin
+      chunks := Buffer.contents cur :: !chunks;
+      Buffer.clear cur
+    end
+  in
+  let inMain = ref true in
+  List.iter
+    (fun l -> 
+      if Str.string_match lineMarker l 0 then begin
+        inMain := (Str.matched_group 3 l = main);
+        if !inMain then flush ()
+      end;
+      if not !inMain then begin
+        Buffer.add_string cur l;
+        Buffer.add_char cur '\n'
+      end)
+    (Str.split_delim (Str.regexp "\n") headers);
+  flush ();
+  List.rev !chunks
+
+(* Parse a file to CIL, reusing the parsed includes when another file started
+ * with the same (any prefix of its top-level includes). Anything unexpected
+ * in the split falls back to parsing the whole file. The whole file is still
+ * converted to CIL. *)
+let parseWithHeaders (fname: string) : C.file = 
+  if !Cilutil.printStages then ignore (E.log "Parsing %s\n" fname);
+  let text = 
+    let ic = open_in_bin fname in
+    let n = in_channel_length ic in
+    let s = String.create n in
+    really_input ic s 0 n;
+    close_in ic;
+    s
+  in
+  let whole () = 
+    E.hadErrors := false;
+    F.parse fname () 
+  in
+  let rec firstN n l = 
+    match l with 
+      x :: rest when n > 0 -> x :: firstN (n - 1) rest
+    | _ -> []
+  in
+  (* The definitions of the chunks, in reverse, and the typedef names *)
+  let rec parseChunks (key: Digest.t) (typedefs: string list) 
+      (acc: Cabs.definition list list) (chunks: string list) = 
+    match chunks with
+      [] -> Some (acc, typedefs)
+    | c :: rest -> begin
+        let key = Digest.string (key ^ c) in
+        let parsed = 
+          try Some (List.assoc key !headerCache)
+          with Not_found -> begin
+            try 
+              let defs = F.parse_string_to_cabs fname typedefs c in
+              Some (defs, typedefs @ F.typedef_names defs)
+            with F.ParseError _ -> None
+          end
+        in
+        match parsed with
+          None -> None
+        | Some ((defs, typedefs') as h) -> 
+            headerCache := 
+              firstN headerCacheSize 
+                ((key, h) :: List.filter (fun (k, _) -> k <> key) !headerCache);
+            parseChunks key typedefs' (defs :: acc) rest
+    end
+  in
+  match splitHeaders text with
+    None -> whole ()
+  | Some (main, headers, rest) -> begin
+      match parseChunks (Digest.string "") [] [] (headerChunks main headers) with
+        None -> whole ()
+      | Some (acc, typedefs) -> begin
+          try
+            let defs' = F.parse_string_to_cabs fname typedefs rest in
+            Stats.time "convert to CIL" Cabs2cil.convFile 
+              (fname, List.concat (List.rev (defs' :: acc)))
+          with F.ParseError _ -> whole ()
+      end
+  end
+
+(* Serve one request. The output and the findings file of the request
+ * replace those of the command line while it runs. Returns false on quit. *)
+let serveRequest (ic: in_channel) (oc: out_channel) : bool = 
+  let files = ref [] in
+  let out = ref "" in
+  let findings = ref "" in
+  let quit = ref false in
+  let rec readRequest () = 
+    match (try Some (input_line ic) with End_of_file -> None) with
+      None | Some "" -> ()
+    | Some l -> begin
+        (match Str.bounded_split (Str.regexp "[ \t]+") l 2 with
+          ["file"; f] -> files := f :: !files
+        | ["out"; f] -> out := f
+        | ["findings"; f] -> findings := f
+        | ["quit"] -> quit := true
+        | _ -> failwith ("bad request line: " ^ l));
+        readRequest ()
+    end
+  in
+  let oldFindings = !Drivers.findings_file in
+  let closeOut () = 
+    (match !outChannel with Some c -> close_out c.fchan | None -> ());
+    outChannel := None;
+    Drivers.findings_file := oldFindings
+  in
+  let reply = 
+    try
+      readRequest ();
+      if !quit then "ok" else begin
+        E.hadErrors := false;
+        let files = 
+          Util.list_map 
+            (fun f -> finishParse (Cilcache.parse parseWithHeaders f))
+            (List.rev !files) 
+        in
+        let one = 
+          match files with
+            [one] -> one
+          | [] -> E.s (E.error "No files in the request")
+          | _ -> Stats.time "merge" (Mergecil.merge files) "server"
+        in
+        if !E.hadErrors then
+          E.s (E.error "Cabs2cil had some errors");
+        if !out <> "" then 
+          outChannel := Some { fname = !out; fchan = open_out !out };
+        if !findings <> "" then Drivers.findings_file := !findings;
+        (try processOneFile one with e -> closeOut (); raise e);
+        closeOut ();
+        "ok"
+      end
+    with 
+      E.Error -> "error see the server log"
+    | F.ParseError msg -> "error " ^ msg
+    | Failure msg | Sys_error msg -> "error " ^ msg
+    | e -> "error " ^ Printexc.to_string e
+  in
+  (try 
+    output_string oc (reply ^ "\n");
+    flush oc
+  with Sys_error _ -> ());
+  not !quit
+
+let runServer (path: string) : unit = 
+  Sys.set_signal Sys.sigpipe Sys.Signal_ignore;
+  (try Unix.unlink path with Unix.Unix_error _ -> ());
+  let sock = Unix.socket Unix.PF_UNIX Unix.SOCK_STREAM 0 in
+  Unix.bind sock (Unix.ADDR_UNIX path);
+  Unix.listen sock 16;
+  let rec loop () = 
+    match (try Some (Unix.accept sock) 
+           with Unix.Unix_error (Unix.EINTR, _, _) -> None) with
+      None -> loop ()
+    | Some (fd, _) -> 
+        let more = 
+          serveRequest (Unix.in_channel_of_descr fd) 
+            (Unix.out_channel_of_descr fd) 
+        in
+        (try Unix.close fd with Unix.Unix_error _ -> ());
+        if more then loop ()
+  in
+  loop ();
+  Unix.close sock;
+  (try Unix.unlink path with Unix.Unix_error _ -> ())
         
 (***** MAIN *****)  
 let theMain () =
@@ -207,6 +442,10 @@ let theMain () =
           "--mergedout", Arg.String (openFile "merged output"
                                        (fun oc -> mergedChannel := Some oc)),
               " specify the name of the merged file";
+          "--cil-cache", Arg.String Cilcache.setCacheDir,
+              "<dir> keep the files converted to CIL in a directory and read\n\t\t\t\tthem back when their source has not changed";
+          "--server", Arg.Set_string serverSocket,
+              "<socket> stay up and process the files sent to a Unix socket";
         ]
         @ F.args @ featureArgs in
   begin
@@ -222,6 +461,12 @@ let theMain () =
 
     if !Cilutil.testcil <> "" then begin
       Testcil.doit !Cilutil.testcil
+    end else if !serverSocket <> "" then begin
+      (* Ptranal keeps its state for the life of the process, so only the
+       * first request could use it *)
+      if Drivers.alias_enabled () then
+        E.s (E.error "--carb-alias cannot be used with --server");
+      runServer !serverSocket
     end else
       (* parse each of the files named on the command line, to CIL *)
       let files = Util.list_map parseOneFile !Ciloptions.fileNames in
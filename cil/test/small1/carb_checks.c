@@ -0,0 +1,87 @@
+/* Bounds and null checks of device values that an earlier check already
+ * covers are dropped, and those a loop does not change are made once before
+ * it (--carb-keep-checks keeps them all). Bounds checks are reported at the
+ * last device read before them.
+ *
+ * CARB-CHECKS: dynamic_array static_array
+ * CARB-COUNT: carb checks hoisted = 1
+ */
+
+unsigned int readl(const volatile void *addr);
+
+struct ring {
+  int head;
+  int tail;
+};
+
+int carb_small[8];
+int carb_large[16];
+
+/* The second dereference of r needs no check of its own */
+int carb_checks(char *base)
+{
+  struct ring *r;
+  int a, b;
+
+  r = (struct ring *) readl(base);
+  a = r->head;                          /* CARB: dynamic_array */
+  b = r->tail;
+  return a + b;
+}
+
+/* A new device pointer is checked again */
+int carb_checks_reload(char *base)
+{
+  struct ring *r;
+  struct ring *q;
+  int a, b;
+
+  r = (struct ring *) readl(base);
+  a = r->head;                          /* CARB: dynamic_array */
+  q = (struct ring *) readl(base + 4);
+  b = q->tail + r->tail;                /* CARB: dynamic_array */
+  return a + b;
+}
+
+/* i < 8 implies i < 16: the second bounds check is dropped */
+int carb_bounds(char *base)
+{
+  int i, a, b;
+
+  i = readl(base);                      /* CARB: static_array */
+  a = carb_small[i];
+  readl(base + 12);
+  b = carb_large[i];
+  return a + b;
+}
+
+/* i does not change in the loop: its check is made once, before it */
+int carb_bounds_loop(char *base)
+{
+  int i, n, sum;
+
+  i = readl(base);                      /* CARB: static_array */
+  sum = 0;
+  n = 0;
+  do {
+    sum += carb_small[i];
+    n++;
+  } while (n < 4);
+  return sum;
+}
+
+/* A call runs before the check in every iteration: it stays in the loop */
+int carb_bounds_loop_call(char *base)
+{
+  int i, n, sum;
+
+  i = readl(base);
+  sum = 0;
+  n = 0;
+  do {
+    readl(base + 12);                   /* CARB: static_array */
+    sum += carb_small[i];
+    n++;
+  } while (n < 4);
+  return sum;
+}
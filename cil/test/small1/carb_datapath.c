@@ -0,0 +1,58 @@
+/* Allocations in the interrupt path, and calls passing GFP_ATOMIC or
+ * GFP_NOWAIT. The gfp flags are the gfp_t argument of the callee, or the
+ * argument at the gfp_arg position of its signature.
+ *
+ * CARB-CHECKS: datapath_alloc
+ */
+
+typedef unsigned int gfp_t;
+typedef int irqreturn_t;
+
+#define __GFP_WAIT 0x10u
+#define __GFP_HIGH 0x20u
+#define __GFP_IO   0x40u
+#define __GFP_FS   0x80u
+#define GFP_ATOMIC (__GFP_HIGH)
+#define GFP_NOWAIT (GFP_ATOMIC & ~__GFP_HIGH)
+#define GFP_NOIO   (__GFP_WAIT)
+#define GFP_KERNEL (__GFP_WAIT | __GFP_IO | __GFP_FS)
+
+void *kmalloc(unsigned long size, gfp_t flags);
+void kfree(const void *obj);
+void *carb_pool_get(void *pool, gfp_t gfp);
+int request_irq(unsigned int irq, irqreturn_t (*handler)(int, void *),
+                unsigned long flags, const char *name, void *dev);
+
+/* Reached from the handler */
+static void *carb_refill(void *pool)
+{
+  return carb_pool_get(pool, GFP_ATOMIC);       /* CARB: datapath_alloc */
+}
+
+static irqreturn_t carb_isr(int irq, void *dev)
+{
+  void *buf;
+  void *obj;
+
+  buf = kmalloc(64, GFP_ATOMIC);                /* CARB: datapath_alloc */
+  obj = carb_pool_get(dev, GFP_KERNEL);
+  kfree(buf);
+  kfree(obj);
+  obj = carb_refill(dev);
+  kfree(obj);
+  obj = carb_pool_get(dev, GFP_NOWAIT);         /* CARB: datapath_alloc */
+  kfree(obj);
+  obj = carb_pool_get(dev, GFP_NOIO);
+  kfree(obj);
+  return 1;
+}
+
+/* Not in the datapath */
+int carb_probe(void *dev)
+{
+  void *buf;
+
+  buf = kmalloc(64, GFP_KERNEL);
+  kfree(buf);
+  return request_irq(5, carb_isr, 0, "carb", dev);
+}
@@ -0,0 +1,58 @@
+/* A DMA sync repeating the sync before it in the same direction, or done
+ * after the unmap, is redundant. A sync for the device after a sync for the
+ * CPU gives the buffer back and is not.
+ *
+ * CARB-CHECKS: redundant_dma_sync
+ */
+
+typedef unsigned long dma_addr_t;
+
+dma_addr_t dma_map_single(void *dev, void *ptr, unsigned long size, int dir);
+void dma_unmap_single(void *dev, dma_addr_t addr, unsigned long size, int dir);
+void dma_sync_single_for_cpu(void *dev, dma_addr_t addr, unsigned long size,
+                             int dir);
+void dma_sync_single_for_device(void *dev, dma_addr_t addr,
+                                unsigned long size, int dir);
+
+struct rx_desc {
+  dma_addr_t dma;
+  int len;
+};
+
+int carb_dmasync(void *dev, void *buf)
+{
+  dma_addr_t h;
+
+  h = dma_map_single(dev, buf, 64, 2);
+  dma_sync_single_for_cpu(dev, h, 64, 2);
+  dma_sync_single_for_cpu(dev, h, 64, 2);       /* CARB: redundant_dma_sync */
+  dma_sync_single_for_device(dev, h, 64, 2);
+  dma_sync_single_for_cpu(dev, h, 64, 2);
+  dma_unmap_single(dev, h, 64, 2);
+  dma_sync_single_for_device(dev, h, 64, 2);    /* CARB: redundant_dma_sync */
+  return 0;
+}
+
+/* Handles kept in a descriptor */
+int carb_dmasync_desc(void *dev, struct rx_desc *d)
+{
+  dma_sync_single_for_device(dev, d->dma, 64, 2);
+  dma_sync_single_for_device(dev, d->dma, 64, 2);       /* CARB: redundant_dma_sync */
+  d->len = 0;
+  dma_sync_single_for_device(dev, d->dma, 64, 2);
+  return 0;
+}
+
+/* Another handle in between does not matter; a sync on one path only is
+ * not repeated */
+int carb_dmasync_paths(void *dev, dma_addr_t h, dma_addr_t h2, int flag)
+{
+  dma_sync_single_for_cpu(dev, h, 64, 2);
+  dma_sync_single_for_cpu(dev, h2, 64, 2);
+  dma_sync_single_for_cpu(dev, h, 64, 2);       /* CARB: redundant_dma_sync */
+  dma_sync_single_for_device(dev, h2, 64, 2);
+  if (flag)
+    dma_sync_single_for_cpu(dev, h2, 64, 2);
+  dma_sync_single_for_cpu(dev, h2, 64, 2);
+  return 0;
+}
@@ -0,0 +1,76 @@
+/* The same null check made in both branches of a condition is made once,
+ * in front of the condition.
+ *
+ * CARB-CHECKS: dynamic_array
+ */
+
+unsigned int readl(const volatile void *addr);
+void spin_unlock(int *lock);
+
+struct ring {
+  int head;
+  int tail;
+};
+
+/* The check of the first branch is moved above the if, which covers the
+ * second */
+int carb_merge(char *base, int flag)
+{
+  struct ring *r;
+  int a;
+
+  r = (struct ring *) readl(base);
+  if (flag)
+    a = r->head;                        /* CARB: dynamic_array */
+  else
+    a = r->tail;
+  return a;
+}
+
+/* Only one branch dereferences r: the check stays in that branch */
+int carb_merge_one_branch(char *base, int flag)
+{
+  struct ring *r;
+  int a;
+
+  r = (struct ring *) readl(base);
+  a = 0;
+  if (flag)
+    a = r->head;                        /* CARB: dynamic_array */
+  return a;
+}
+
+/* The branches check different pointers: no common check */
+int carb_merge_other(char *base, int flag)
+{
+  struct ring *r;
+  struct ring *q;
+  int a;
+
+  r = (struct ring *) readl(base);
+  if (flag) {
+    a = r->head;                        /* CARB: dynamic_array */
+  } else {
+    q = (struct ring *) readl(base + 4);
+    a = q->tail;                        /* CARB: dynamic_array */
+  }
+  return a;
+}
+
+/* A check is never moved above a call: both branches unlock before the
+ * dereference, so each keeps its check after the unlock */
+int carb_merge_call(char *base, int *lock, int flag)
+{
+  struct ring *r;
+  int a;
+
+  r = (struct ring *) readl(base);
+  if (flag) {
+    spin_unlock(lock);
+    a = r->head;                        /* CARB: dynamic_array */
+  } else {
+    spin_unlock(lock);
+    a = r->tail;                        /* CARB: dynamic_array */
+  }
+  return a;
+}
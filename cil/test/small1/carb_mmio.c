@@ -0,0 +1,66 @@
+/* A register read again with no write, barrier or other call in between is
+ * redundant. Reading it again in the next iteration of a loop is polling.
+ *
+ * CARB-CHECKS: redundant_mmio_read
+ */
+
+unsigned int readl(const volatile void *addr);
+void writel(unsigned int value, volatile void *addr);
+
+unsigned int carb_mmio(char *base)
+{
+  unsigned int a, b, c;
+
+  a = readl(base + 4);
+  b = readl(base + 4);                  /* CARB: redundant_mmio_read */
+  writel(1, base);
+  c = readl(base + 4);
+  return a + b + c;
+}
+
+/* Another register, and the same register through another base */
+unsigned int carb_mmio_other(char *base, char *base2)
+{
+  unsigned int a, b, c;
+
+  a = readl(base + 4);
+  b = readl(base + 8);
+  c = readl(base2 + 4);
+  return a + b + c;
+}
+
+/* The address changes in between */
+unsigned int carb_mmio_moved(char *base)
+{
+  unsigned int a, b;
+
+  a = readl(base + 4);
+  base = base + 16;
+  b = readl(base + 4);
+  return a + b;
+}
+
+/* Polling: the read of the next iteration is not redundant */
+unsigned int carb_mmio_while(char *base)
+{
+  unsigned int s;
+
+  s = readl(base + 8);
+  while (!(s & 1))
+    s = readl(base + 8);
+  return s;
+}
+
+/* The same with a loop made of gotos */
+unsigned int carb_mmio_goto(char *base)
+{
+  unsigned int s;
+
+  s = readl(base + 8);
+again:
+  if (!(s & 1)) {
+    s = readl(base + 8);
+    goto again;
+  }
+  return s;
+}
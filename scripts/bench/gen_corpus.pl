@@ -0,0 +1,192 @@
+#!/usr/bin/perl
+#
+# Writes the benchmark corpus of scripts/bench/run_bench.pl: preprocessed
+# (.i) driver-shaped files of increasing size. Every file is self-contained
+# (the device API is declared at the top), so no kernel tree is needed.
+#
+#   poll-N.i     N functions busy-waiting on device registers
+#   array-N.i    N functions indexing rings and tables with device values
+#   merged-N.i   a merged module of N functions of every kind calling each
+#                other, with device values returned and passed down
+#
+# Usage: gen_corpus.pl [-o DIR]   (default ./bench-corpus)
+#
+# The output only depends on the sizes below, so runs against a baseline
+# always analyze the same files.
+
+use strict;
+use warnings;
+use File::Path qw(mkpath);
+use Getopt::Long;
+
+my $outdir = "bench-corpus";
+GetOptions("o=s" => \$outdir) or die "Bad options, see the header of $0\n";
+
+my %sizes = (poll => [50, 200, 800],
+             array => [50, 200, 800],
+             merged => [500, 2000, 5000]);
+
+my $prologue = <<'EOF';
+typedef unsigned char u8;
+typedef unsigned short u16;
+typedef unsigned int u32;
+typedef unsigned long size_t;
+extern u8 inb(unsigned long port);
+extern u32 inl(unsigned long port);
+extern void outb(u8 value, unsigned long port);
+extern u32 readl(const volatile void *addr);
+extern void writel(u32 value, volatile void *addr);
+extern void *ioremap(unsigned long offset, unsigned long size);
+extern int printk(const char *fmt, ...);
+extern void *kmalloc(size_t size, int flags);
+extern void kfree(const void *p);
+extern int request_irq(unsigned int irq, int (*handler)(int, void *),
+                       unsigned long flags, const char *name, void *dev);
+extern void udelay(unsigned long usecs);
+
+struct desc {
+  u32 addr;
+  u16 len;
+  u16 status;
+  struct desc *next;
+};
+
+struct nic {
+  void *regs;
+  unsigned long port;
+  u32 ring[256];
+  u32 stats[64];
+  struct desc *rx;
+  int irq;
+};
+EOF
+
+# One function of each kind. $n makes the names unique. The callee of
+# chain_fn is a function defined before it, or undef for a device read.
+sub poll_fn {
+    my ($n) = @_;
+    return <<"EOF";
+int poll_ready_$n(struct nic *nic)
+{
+  u32 status;
+  status = readl(nic->regs + 0x10);
+  while (!(status & 0x1))
+    status = readl(nic->regs + 0x10);
+  while ((inb(nic->port + 5) & 0x20) == 0)
+    udelay(1);
+  if (status == 0xffffffff)
+    return -5;
+  return 0;
+}
+
+EOF
+}
+
+sub array_fn {
+    my ($n) = @_;
+    return <<"EOF";
+static u32 table_$n\[32\];
+
+int fill_ring_$n(struct nic *nic, u32 *out)
+{
+  u32 idx = readl(nic->regs + 0x20);
+  u32 i;
+  u32 sum = 0;
+  table_$n\[idx\] = idx;
+  for (i = 0; i < 16; i++)
+    sum += table_$n\[idx\] + table_$n\[i\];
+  if (idx < 32)
+    out[0] = table_$n\[idx\];
+  return sum;
+}
+
+EOF
+}
+
+sub deref_fn {
+    my ($n) = @_;
+    return <<"EOF";
+int rx_desc_$n(struct nic *nic)
+{
+  struct desc *d = (struct desc *) (unsigned long) readl(nic->regs + 0x30);
+  int len = 0;
+  while (d) {
+    len += d->len;
+    d->status = 0;
+    d = d->next;
+  }
+  return len;
+}
+
+EOF
+}
+
+sub chain_fn {
+    my ($n, $callee) = @_;
+    my $call = defined $callee ? "$callee(nic)" : "inl(nic->port)";
+    return <<"EOF";
+u32 read_reg_$n(struct nic *nic)
+{
+  u32 v = $call;
+  if (v == 0)
+    printk("<3>read_reg_$n: no device\\n");
+  return v + 1;
+}
+
+EOF
+}
+
+sub irq_fn {
+    my ($n) = @_;
+    return <<"EOF";
+int isr_$n(int irq, void *dev)
+{
+  struct nic *nic = dev;
+  u32 cause = readl(nic->regs + 0x40);
+  if (!cause)
+    return 0;
+  nic->stats[cause] += 1;
+  writel(cause, nic->regs + 0x40);
+  return 1;
+}
+
+int open_$n(struct nic *nic)
+{
+  return request_irq(nic->irq, isr_$n, 0, "bench", nic);
+}
+
+EOF
+}
+
+sub write_file {
+    my ($name, $body) = @_;
+    my $path = "$outdir/$name.i";
+    open(my $fh, ">", $path) or die "$path: $!\n";
+    print $fh $prologue, "\n", $body;
+    close($fh);
+    print "$path\n";
+}
+
+mkpath($outdir);
+foreach my $n (@{$sizes{poll}}) {
+    write_file("poll-$n", join("", map { poll_fn($_) } 1 .. $n));
+}
+foreach my $n (@{$sizes{array}}) {
+    write_file("array-$n", join("", map { array_fn($_) } 1 .. $n));
+}
+foreach my $n (@{$sizes{merged}}) {
+    my @kinds = (\&poll_fn, \&array_fn, \&deref_fn, \&chain_fn, \&irq_fn);
+    my $body = "";
+    my $last_chain;
+    foreach my $i (1 .. $n) {
+        my $kind = $kinds[$i % @kinds];
+        if ($kind == \&chain_fn) {
+            # Chains of up to 8 callers over tainted returns
+            $body .= chain_fn($i, ($i % 40) ? $last_chain : undef);
+            $last_chain = "read_reg_$i";
+        } else {
+            $body .= $kind->($i);
+        }
+    }
+    write_file("merged-$n", $body);
+}
@@ -0,0 +1,137 @@
+#!/usr/bin/perl
+#
+# Times the Carburizer analysis over the benchmark corpus (gen_corpus.pl)
+# and compares the results with a stored baseline.
+#
+# Every file is analyzed with cilly.asm --dodrivers --carb-bench. The file
+# results are the wall time, the peak RSS (from GNU time) and, for each phase,
+# the wall time and allocation printed by --carb-bench. Each file is run -r
+# times and the best run is kept.
+#
+# Usage:
+#   run_bench.pl [options] FILE.i ...
+#     --cilly C         cilly.asm to run (default cilly.asm.exe in the PATH)
+#     -r N              runs per file (default 3)
+#     -o FILE           write the results to FILE (TSV: file, metric, value)
+#     --baseline FILE   compare with the results in FILE and exit 1 on a
+#                       regression
+#     --threshold P     allowed slowdown or growth, in percent (default 10)
+#     -- ARGS           extra cilly arguments (e.g. -- --carb-jobs 4)
+#
+# Time differences under 50 ms are noise and never count as regressions.
+
+use strict;
+use warnings;
+use File::Basename;
+use Getopt::Long;
+use Time::HiRes qw(gettimeofday tv_interval);
+
+my $cilly = "cilly.asm.exe";
+my $runs = 3;
+my $outfile;
+my $basefile;
+my $threshold = 10;
+
+GetOptions("cilly=s" => \$cilly,
+           "r=i" => \$runs,
+           "o=s" => \$outfile,
+           "baseline=s" => \$basefile,
+           "threshold=f" => \$threshold)
+    or die "Bad options, see the header of $0\n";
+
+# Files before "--", cilly arguments after
+my @files;
+push @files, shift @ARGV while @ARGV && $ARGV[0] ne "--";
+shift @ARGV;
+my @extra = @ARGV;
+die "No benchmark files, see the header of $0\n" unless @files;
+
+my $gnutime = "/usr/bin/time";
+my @timecmd = (-x $gnutime) ? ($gnutime, "-f", "carb-rss %M") : ();
+warn "No $gnutime (GNU time), the peak RSS is not measured\n" unless @timecmd;
+
+# One run of the analysis. Returns the metrics, or dies with the log.
+sub run_once {
+    my ($file) = @_;
+    my @cmd = (@timecmd, $cilly, "--dodrivers",
+               "--carb-bench", @extra, "--out", "/dev/null", $file);
+    my $t0 = [gettimeofday];
+    my $log = "";
+    open(my $ph, "-|", join(" ", map { quotemeta } @cmd) . " 2>&1")
+        or die "Cannot run $cilly: $!\n";
+    $log .= $_ while <$ph>;
+    close($ph);
+    my $wall = tv_interval($t0);
+    die "$file failed:\n$log" if $?;
+    my %m = (wall => $wall);
+    foreach (split /\n/, $log) {
+        if (/^carb-rss (\d+)/) {
+            $m{rss_kb} = $1;
+        } elsif (/^carb-bench (\S+) (.*)/) {
+            my $phase = $1;
+            foreach my $kv (split / /, $2) {
+                my ($k, $v) = split /=/, $kv;
+                $m{"$phase.$k"} = $v;
+            }
+        }
+    }
+    return \%m;
+}
+
+# Lower is better for every metric, so the best run is the minimum
+my %results;
+foreach my $file (@files) {
+    my $name = basename($file, ".i");
+    my %best;
+    foreach (1 .. $runs) {
+        my $m = run_once($file);
+        foreach my $k (keys %{$m}) {
+            $best{$k} = $m->{$k}
+                if !defined $best{$k} || $m->{$k} < $best{$k};
+        }
+    }
+    $results{$name} = \%best;
+    printf "%-16s %8.3fs %8d KB\n", $name, $best{wall}, $best{rss_kb} || 0;
+}
+
+if (defined $outfile) {
+    open(my $out, ">", $outfile) or die "$outfile: $!\n";
+    foreach my $name (sort keys %results) {
+        foreach my $k (sort keys %{$results{$name}}) {
+            print $out "$name\t$k\t$results{$name}{$k}\n";
+        }
+    }
+    close($out);
+}
+
+exit 0 unless defined $basefile;
+
+open(my $bf, "<", $basefile) or die "$basefile: $!\n";
+my %base;
+while (<$bf>) {
+    chomp;
+    my ($name, $k, $v) = split /\t/;
+    $base{$name}{$k} = $v if defined $v;
+}
+close($bf);
+
+# Only times, allocation and RSS are compared. Collection counts follow
+# from the allocation.
+my $regressions = 0;
+foreach my $name (sort keys %results) {
+    next unless $base{$name};
+    foreach my $k (sort keys %{$results{$name}}) {
+        next unless $k =~ /(^wall|\.wall|alloc_mw|heap_mw|^rss_kb)$/;
+        my $old = $base{$name}{$k};
+        my $new = $results{$name}{$k};
+        next unless defined $old && $old > 0;
+        next if $k =~ /wall$/ && $new - $old < 0.05;
+        if ($new > $old * (1 + $threshold / 100)) {
+            printf "REGRESSION %s %s: %s -> %s (+%.0f%%)\n", $name, $k, $old,
+                $new, ($new / $old - 1) * 100;
+            $regressions++;
+        }
+    }
+}
+print "No regressions against $basefile\n" unless $regressions;
+exit($regressions ? 1 : 0);
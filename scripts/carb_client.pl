@@ -0,0 +1,59 @@
+#!/usr/bin/perl
+#
+# Sends files to a resident Carburizer (cilly --server SOCKET) instead of
+# starting cilly for each of them. The server keeps the parsed kernel
+# headers between requests, so only the code of each file is parsed again.
+#
+# Start the server once with the analysis options, e.g.
+#   cilly.asm.exe --dodrivers --carb-guard time --server /tmp/carb.sock &
+#
+# Usage:
+#   carb_client.pl -s SOCKET [options] FILE.i ...
+#     -o FILE     write the hardened C to FILE
+#     -f FILE     append the findings to FILE (JSON Lines, see --carb-findings)
+#     --quit      stop the server
+#
+# Several files are merged into one program, as by cilly --merge. Exits 1
+# when the server reports an error (the details are in the server's log).
+
+use strict;
+use warnings;
+use File::Spec;
+use Getopt::Long;
+use IO::Socket::UNIX;
+
+my $socket;
+my $outfile;
+my $findings;
+my $quit = 0;
+
+GetOptions("s=s" => \$socket,
+           "o=s" => \$outfile,
+           "f=s" => \$findings,
+           "quit" => \$quit)
+    or die "Bad options, see the header of $0\n";
+die "No socket, see the header of $0\n" unless defined $socket;
+die "No files, see the header of $0\n" unless @ARGV || $quit;
+
+my $conn = IO::Socket::UNIX->new(Type => SOCK_STREAM, Peer => $socket)
+    or die "Cannot connect to $socket: $!\n";
+
+# The server has its own working directory
+my @request;
+if ($quit) {
+    push @request, "quit";
+} else {
+    push @request, map { "file " . File::Spec->rel2abs($_) } @ARGV;
+    push @request, "out " . File::Spec->rel2abs($outfile) if defined $outfile;
+    push @request, "findings " . File::Spec->rel2abs($findings)
+        if defined $findings;
+}
+print $conn join("\n", @request), "\n\n";
+
+my $reply = <$conn>;
+close($conn);
+die "No reply from $socket\n" unless defined $reply;
+chomp $reply;
+exit 0 if $reply eq "ok";
+print STDERR "$reply\n";
+exit 1;
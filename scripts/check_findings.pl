@@ -0,0 +1,94 @@
+#!/usr/bin/perl
+#
+# Compares the findings of a Carburizer run (--carb-findings, JSON Lines)
+# with the findings a test source expects (cil/test/small1/carb_*.c).
+#
+# The test lists the categories it checks on a line of its own:
+#
+#   CARB-CHECKS: dynamic_array redundant_mmio_read
+#
+# and marks each line that should get a finding of one of them with a
+# comment naming the category:
+#
+#   x = *p;     /* CARB: dynamic_array */
+#
+# Every finding of a checked category must be on a marked line, and every
+# marked line must get its finding. Other categories are ignored.
+#
+# A test can also give the value of a counter of --carb-stats-json (the
+# counters of --stats), for what the findings do not show:
+#
+#   CARB-COUNT: carb checks hoisted = 1
+#
+# Usage:
+#   check_findings.pl TEST.c FINDINGS.jsonl [STATS.json]
+
+use strict;
+use warnings;
+use JSON::PP;
+
+@ARGV == 2 || @ARGV == 3
+    or die "Usage: $0 TEST.c FINDINGS.jsonl [STATS.json]\n";
+my ($source, $findfile, $statsfile) = @ARGV;
+
+my %checked;
+my %expected;
+my %counts;
+open(my $src, "<", $source) or die "Cannot open $source: $!\n";
+while (my $line = <$src>) {
+    if ($line =~ /CARB-CHECKS:\s*(.*?)\s*(\*\/)?\s*$/) {
+        $checked{$_} = 1 foreach split(/\s+/, $1);
+    }
+    if ($line =~ /CARB-COUNT:\s*(.*?)\s*=\s*(\d+)/) {
+        $counts{$1} = $2;
+    }
+    while ($line =~ /CARB:\s*(\w+)/g) {
+        $expected{"$.:$1"}++;
+    }
+}
+close($src);
+die "$source lists no CARB-CHECKS categories\n" unless %checked;
+die "$source gives counters but no stats file\n" if %counts && !$statsfile;
+
+my %found;
+open(my $fh, "<", $findfile) or die "Cannot open $findfile: $!\n";
+while (my $line = <$fh>) {
+    next if $line =~ /^\s*$/;
+    my $fi = decode_json($line);
+    next unless $checked{$fi->{category}};
+    $found{"$fi->{line}:$fi->{category}"}++;
+}
+close($fh);
+
+my $errors = 0;
+foreach my $k (sort keys %expected) {
+    my ($line, $cat) = split(/:/, $k);
+    my $n = $found{$k} || 0;
+    if ($n < $expected{$k}) {
+        print "$source:$line: missing $cat finding\n";
+        $errors++;
+    }
+}
+foreach my $k (sort keys %found) {
+    my ($line, $cat) = split(/:/, $k);
+    my $n = $expected{$k} || 0;
+    if ($found{$k} > $n) {
+        print "$source:$line: unexpected $cat finding\n";
+        $errors++;
+    }
+}
+
+if (%counts) {
+    open(my $sh, "<", $statsfile) or die "Cannot open $statsfile: $!\n";
+    my $stats = decode_json(do { local $/; <$sh> });
+    close($sh);
+    foreach my $label (sort keys %counts) {
+        my $n = $stats->{counters}{$label};
+        if (!defined $n || $n != $counts{$label}) {
+            printf "%s: counter \"%s\" is %s, expected %d\n", $source, $label,
+                defined $n ? $n : "missing", $counts{$label};
+            $errors++;
+        }
+    }
+}
+exit($errors ? 1 : 0);
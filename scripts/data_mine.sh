@@ -1,28 +1,52 @@
-echo '=====================Infinite Loops=================================';
-awk '$1=="ticks" {printf "%s %s\n",$0,p;} {p=$0;}' make_log.txt >   \
-single_line.txt
-awk '{if (NF == 19) {split($19,a,"/");printf "%d %s\n",$2,a[2];}} {if (NF == 20) \
-{split ($20,b,"/");printf "%d %s\n",$2,b[2];}} ' single_line.txt   > ticks_dir.txt
-awk '{if (NF == 19) {split($19,a,"/");printf "%d %s\n",$4,a[2];}} {if (NF == 20) \
-{split ($20,b,"/");printf "%d %s\n",$4,b[2];}} ' single_line.txt   > \
-array_dir.txt
-awk ' {a[$2] +=$1;a[total] += $1;} END{ for (dir in a) printf "%s, %d\n",dir,a[dir];printf "total %d\n",a[total];}' ticks_dir.txt  
-echo '====================Array unsafe=============================================';
-awk ' {a[$2] +=$1;a[total] += $1;} END{ for (dir in a) printf "%s, %d\n",dir,a[dir];printf "total %d\n",a[total];}' array_dir.txt
-echo '====================Mem De-ref===========================================';
-./deref.sh
-echo '=====================Return on halt============================================';
-awk '{if (NF == 19) {split($19,a,"/");printf "%d %s\n",$9,a[2];}} {if (NF == 20) {split ($20,b,"/");printf "%d %s\n",$9,b[2];}} ' single_line.txt  > md.txt
-awk ' {a[$2] +=$1;a[total] += $1;} END{ for (dir in a) printf "%s, %d\n",dir,a[dir]; printf "total %d\n",a[total];}' md.txt
-echo '=====================Report on ret==========================================';
-awk '{if (NF == 19) {split($19,a,"/");printf "%d %s\n",$11,a[2];}} {if (NF == 20) {split ($20,b,"/");printf "%d %s\n",$11,b[2];}} ' single_line.txt  > md.txt
-awk ' {a[$2] +=$1;a[total] += $1;} END{ for (dir in a) printf "%s, %d\n",dir,a[dir]; printf "total %d\n",a[total];}' md.txt
-echo '=====================Report on false stuck-at==========================================';
-awk '{if (NF == 19) {split($19,a,"/");printf "%d %s\n",$11,a[2];}} {if (NF == 20) {split ($20,b,"/");printf "%d %s\n",$13,b[2];}} ' single_line.txt  > md.txt
-awk ' {a[$2] +=$1;a[total] += $1;} END{ for (dir in a) printf "%s, %d\n",dir,a[dir]; printf "total %d\n",a[total];}' md.txt
-echo '=====================Security Bugs==========================================';
-awk '{if (NF == 19) {split($19,a,"/");printf "%d %s\n",$13,a[2];}} {if (NF == 20) {split ($20,b,"/");printf "%d %s\n",$15,b[2];}} ' single_line.txt  > md.txt
-awk ' {a[$2] +=$1;a[total] += $1;} END{ for (dir in a) printf "%s, %d\n",dir,a[dir]; printf "total %d\n",a[total];}' md.txt
-echo '=====================schedule() in infinite loop==========================================';
-awk '{if (NF == 19) {split($19,a,"/");printf "%d %s\n",$15,a[2];}} {if (NF == 20) {split ($20,b,"/");printf "%d %s\n",$17,b[2];}} ' single_line.txt  > md.txt
-awk ' {a[$2] +=$1;a[total] += $1;} END{ for (dir in a) printf "%s, %d\n",dir,a[dir]; printf "total %d\n",a[total];}' md.txt
+# Bug counts per driver directory, from the findings of a run
+# (cilly --carb-findings FILE, or carb-out/findings.jsonl of scan_tree.pl).
+# One pass over the findings, one record per line.
+#
+# Usage: data_mine.sh [findings.jsonl]
+
+awk '
+function value(key,   n) {
+  n = length(key) + 5;
+  if (!match($0, "\"" key "\":\"[^\"]*\"")) return "";
+  return substr($0, RSTART + n - 1, RLENGTH - n);
+}
+{
+  cat = value("category");
+  file = value("file");
+  # The directory under drivers/ (net, scsi, ...), as in the make log days
+  n = split(file, part, "/");
+  dir = "";
+  for (i = 1; i < n; i++)
+    if (part[i] == "drivers") { dir = part[i + 1]; break; }
+  if (dir == "") dir = (n > 1) ? part[n - 1] : ".";
+  count[cat, dir]++;
+  total[cat]++;
+  dirs[cat, dir] = dir;
+}
+END {
+  split("infinite_loop static_array dynamic_array missing_error_report " \
+        "missing_timeout_report reused_pointer redundant_mmio_read busy_wait " \
+        "datapath_alloc datapath_dma_map redundant_dma_sync dma_map_in_loop", \
+        order, " ");
+  title["infinite_loop"] = "Infinite Loops";
+  title["static_array"] = "Array unsafe";
+  title["dynamic_array"] = "Mem De-ref";
+  title["missing_error_report"] = "Report on ret";
+  title["missing_timeout_report"] = "Report on false stuck-at";
+  title["reused_pointer"] = "Reused device pointers";
+  title["redundant_mmio_read"] = "Redundant device reads";
+  title["busy_wait"] = "Busy waits";
+  title["datapath_alloc"] = "Datapath allocations";
+  title["datapath_dma_map"] = "Datapath DMA mappings";
+  title["redundant_dma_sync"] = "Redundant DMA syncs";
+  title["dma_map_in_loop"] = "DMA maps in loops";
+  for (k = 1; k in order; k++) {
+    cat = order[k];
+    printf "=====================%s=====================\n", title[cat];
+    for (key in dirs) {
+      split(key, ck, SUBSEP);
+      if (ck[1] == cat) printf "%s, %d\n", ck[2], count[key];
+    }
+    printf "total %d\n", total[cat];
+  }
+}' "${1:-findings.jsonl}"
@@ -0,0 +1,251 @@
+#!/usr/bin/perl
+#
+# Runs Carburizer over a kernel tree from the build's compile commands,
+# instead of patching every Makefile (edit_Makefiles.sh) and building
+# serially through cilly.
+#
+# The sources of a kbuild module are one merge group, so multi-file drivers
+# like e1000 are analyzed as a whole. The objects of a module are read from
+# the .mod files of the build, and those of a composite object built in
+# (foo-objs, foo-y) from the Makefile of its directory. Any other source is a
+# group of its own. Groups run on a local pool of jobs. Nothing is written to
+# the source tree: merged objects, logs, the findings (as JSON Lines, see
+# scripts/data_mine.sh) and the summary go to the output directory.
+#
+# Usage:
+#   scan_tree.pl [options] [-- extra cilly args]
+#     -p FILE     compile_commands.json of the kernel build
+#                 (default ./compile_commands.json)
+#     -o DIR      output directory (default ./carb-out)
+#     -j N        parallel jobs (default: number of cores)
+#     --prefix P  only scan sources under P, relative to the tree
+#                 (default drivers/)
+#     --per-file  analyze every source on its own, even those of a module
+#     --cilly C   cilly to run (default cilly)
+#
+# Generate the compile commands with scripts/gen_compile_commands.py in the
+# kernel tree (or bear) after a normal build.
+
+use strict;
+use warnings;
+use Cwd qw(abs_path getcwd);
+use File::Basename;
+use File::Find;
+use File::Path qw(mkpath);
+use File::Spec;
+use Getopt::Long;
+use JSON::PP;
+use POSIX qw(:sys_wait_h);
+use Text::ParseWords;
+
+my $ccfile = "compile_commands.json";
+my $outdir = "carb-out";
+my $jobs = 0;
+my $prefix = "drivers/";
+my $perfile = 0;
+my $cilly = "cilly";
+
+GetOptions("p=s" => \$ccfile,
+           "o=s" => \$outdir,
+           "j=i" => \$jobs,
+           "prefix=s" => \$prefix,
+           "per-file" => \$perfile,
+           "cilly=s" => \$cilly)
+    or die "Bad options, see the header of $0\n";
+my @carbargs = @ARGV;
+
+if ($jobs <= 0) {
+    $jobs = `getconf _NPROCESSORS_ONLN 2>/dev/null` || 1;
+    chomp $jobs;
+}
+
+open(my $fh, "<", $ccfile) or die "Cannot open $ccfile: $!\n";
+my $entries = decode_json(do { local $/; <$fh> });
+close($fh);
+my $tree = dirname(abs_path($ccfile));
+mkpath($outdir);
+$outdir = abs_path($outdir);
+
+# The group of each object (relative to the tree): the module or composite
+# object it is linked into
+my %group_of;
+
+# The .mod files of the modules under the prefix. Since 5.3 foo.mod is next
+# to the objects and lists them; before, .tmp_versions/foo.mod names the .ko
+# on its first line and lists the objects on the second.
+sub read_mod_files {
+    my @dirs = grep { -d } ("$tree/$prefix", "$tree/.tmp_versions");
+    return unless @dirs;
+    find({ no_chdir => 1, wanted => sub {
+        return unless /\.mod$/ && -f $_;
+        open(my $mh, "<", $_) or return;
+        my @words = split(/\s+/, do { local $/; <$mh> });
+        close($mh);
+        my $group = File::Spec->abs2rel($_, $tree);
+        $group =~ s/\.mod$//;
+        @words = map { File::Spec->file_name_is_absolute($_)
+                           ? File::Spec->abs2rel($_, $tree) : $_ } @words;
+        foreach my $w (@words) {
+            $group = $1 if $w =~ /^(.*)\.ko$/;
+        }
+        foreach my $w (@words) {
+            $group_of{$w} = $group if $w =~ /\.o$/;
+        }
+    }}, @dirs);
+}
+
+# The composite objects of a directory (foo-objs := a.o b.o, foo-y += c.o,
+# foo-$(CONFIG_BAR) += d.o), for drivers built into the kernel. The .mod
+# files take precedence.
+my %makefile_read;
+sub read_makefile {
+    my ($dir) = @_;
+    return if $makefile_read{$dir}++;
+    foreach my $mf ("$tree/$dir/Kbuild", "$tree/$dir/Makefile") {
+        open(my $mh, "<", $mf) or next;
+        my $text = do { local $/; <$mh> };
+        close($mh);
+        $text =~ s/\\\n/ /g;
+        foreach my $line (split(/\n/, $text)) {
+            next unless $line =~
+                /^\s*([\w-]+?)-(?:objs|y|\$\(CONFIG_\w+\))\s*[:+]?=\s*(.*)$/;
+            my ($name, $objs) = ($1, $2);
+            next if $name =~ /^(obj|lib|subdir|ccflags|asflags|ldflags|always|extra|targets|hostprogs|clean)$/;
+            $objs =~ s/#.*//;
+            foreach my $o (split(/\s+/, $objs)) {
+                next unless $o =~ /\.o$/;
+                my $obj = File::Spec->canonpath("$dir/$o");
+                $group_of{$obj} = "$dir/$name" unless exists $group_of{$obj};
+            }
+        }
+        last;
+    }
+}
+
+read_mod_files() unless $perfile;
+
+# Group the compile commands of the sources under the prefix
+my %groups;
+foreach my $e (@{$entries}) {
+    my $file = $e->{file};
+    $file = File::Spec->rel2abs($file, $e->{directory});
+    my $rel = File::Spec->abs2rel($file, $tree);
+    next unless $rel =~ /\.c$/ && index($rel, $prefix) == 0;
+    my $group = $rel;
+    unless ($perfile) {
+        read_makefile(dirname($rel));
+        (my $obj = $rel) =~ s/\.c$/.o/;
+        $group = $group_of{$obj} if exists $group_of{$obj};
+    }
+    push @{$groups{$group}}, { %{$e}, rel => $rel };
+}
+
+# The compile command of a source, turned into a cilly --merge command that
+# writes its object to $obj. Dependency files are not generated, so the
+# source tree is left alone.
+sub merge_command {
+    my ($e, $obj) = @_;
+    my @args = $e->{arguments} ? @{$e->{arguments}}
+                               : shellwords($e->{command});
+    shift @args;                    # The compiler
+    my @cmd = ($cilly, "--merge");
+    while (@args) {
+        my $a = shift @args;
+        if ($a eq "-o" || $a eq "-MF" || $a eq "-MT" || $a eq "-MQ") {
+            shift @args;
+        } elsif ($a =~ /^-(o|MF|MT|MQ)./ || $a =~ /^-Wp,-M/
+                 || $a eq "-MD" || $a eq "-MMD") {
+            # Output or dependency file
+        } else {
+            push @cmd, $a;
+        }
+    }
+    push @cmd, "-o", $obj;
+    return @cmd;
+}
+
+# Runs a command in a directory, appending its output to the log
+sub run_logged {
+    my ($dir, $log, @cmd) = @_;
+    my $pid = fork();
+    die "fork: $!\n" unless defined $pid;
+    if ($pid == 0) {
+        chdir($dir) or die "chdir $dir: $!\n";
+        open(STDOUT, ">>", $log) or die "$log: $!\n";
+        open(STDERR, ">&STDOUT");
+        exec(@cmd) or exit(127);
+    }
+    waitpid($pid, 0);
+    return $?;
+}
+
+# Compiles the sources of one group into merged objects, then runs the
+# analysis on the merged program.
+sub scan_group {
+    my ($group) = @_;
+    my $gdir = "$outdir/$group";
+    mkpath($gdir);
+    my $log = "$gdir/log.txt";
+    unlink($log, "$gdir/findings.jsonl");
+    $ENV{CILLY_DONT_COMPILE_AFTER_MERGE} = 1;
+    $ENV{CILLY_DONT_LINK_AFTER_MERGE} = 1;
+    my @objs;
+    foreach my $e (@{$groups{$group}}) {
+        my $obj = "$gdir/" . basename($e->{rel}, ".c") . ".o";
+        return 1 if run_logged($e->{directory}, $log, merge_command($e, $obj));
+        push @objs, $obj;
+    }
+    return run_logged($gdir, $log, $cilly, "--merge", "--dodrivers",
+                      "--carb-findings", "$gdir/findings.jsonl",
+                      @carbargs, @objs, "-o", "$gdir/merged") ? 2 : 0;
+}
+
+# Largest groups first, so the pool does not end waiting on one of them
+my @order = sort { @{$groups{$b}} <=> @{$groups{$a}} || $a cmp $b }
+            keys %groups;
+my %running;
+my %status;
+while (@order || %running) {
+    while (@order && keys(%running) < $jobs) {
+        my $group = shift @order;
+        my $pid = fork();
+        die "fork: $!\n" unless defined $pid;
+        if ($pid == 0) {
+            exit(scan_group($group));
+        }
+        $running{$pid} = $group;
+    }
+    my $pid = waitpid(-1, 0);
+    last if $pid <= 0;
+    next unless exists $running{$pid};
+    $status{delete $running{$pid}} = $? == 0 ? 0 : (($? >> 8) || 2);
+}
+
+# Summary, the combined log and the findings, in group order
+my @what = ("ok", "compile failed", "analysis failed");
+open(my $sum, ">", "$outdir/summary.txt") or die "$outdir/summary.txt: $!\n";
+open(my $all, ">", "$outdir/scan_log.txt") or die "$outdir/scan_log.txt: $!\n";
+open(my $found, ">", "$outdir/findings.jsonl")
+    or die "$outdir/findings.jsonl: $!\n";
+my $failed = 0;
+foreach my $group (sort keys %groups) {
+    my $st = $status{$group};
+    $st = 2 unless defined $st;
+    $failed++ if $st;
+    printf $sum "%s %s\n", $group, $what[$st] || "failed";
+    print $all "==== $group\n";
+    if (open(my $log, "<", "$outdir/$group/log.txt")) {
+        print $all $_ while <$log>;
+        close($log);
+    }
+    if (open(my $in, "<", "$outdir/$group/findings.jsonl")) {
+        print $found $_ while <$in>;
+        close($in);
+    }
+}
+close($sum);
+close($all);
+close($found);
+printf "Scanned %d groups, %d failed. Results in %s\n",
+    scalar(keys %groups), $failed, $outdir;
+exit($failed ? 1 : 0);